@@ -0,0 +1,173 @@
+#include "AudioRing.h"
+
+#include <algorithm>
+#include <cstring>
+
+AudioRing::AudioRing()
+{
+	mask = 0;
+	head = 0;
+	tail = 0;
+	discardPosition = 0;
+	markSequence = 0;
+	markPosition = 0;
+	markTime = 0.0;
+	markSerial = -1;
+}
+
+//	The capacity is rounded up to a power of two. Drops everything that was buffered.
+void AudioRing::Init(unsigned int capacity)
+{
+	unsigned int size = 1;
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+
+	samples.assign(size, 0.0f);
+	mask = size - 1;
+	head = 0;
+	tail = 0;
+	discardPosition = 0;
+	markPosition = 0;
+	markSerial = -1;
+}
+
+/**
+ * Appends as many of the samples as fit.
+ *
+ * @return the number of samples that were written.
+ */
+unsigned int AudioRing::Write(const float* input, unsigned int count)
+{
+	if (samples.empty())
+	{
+		return 0;
+	}
+
+	uint64_t writeIndex = tail.load(std::memory_order_relaxed);
+	unsigned int space = Capacity() - (unsigned int)(writeIndex - head.load(std::memory_order_acquire));
+	count = std::min(count, space);
+
+	//	Up to the end of the storage, then the rest from the start.
+	unsigned int offset = (unsigned int)writeIndex & mask;
+	unsigned int first = std::min(count, Capacity() - offset);
+	memcpy(&samples[offset], input, first * sizeof(float));
+	memcpy(&samples[0], input + first, (count - first) * sizeof(float));
+
+	tail.store(writeIndex + count, std::memory_order_release);
+	return count;
+}
+
+//	Everything written so far belongs to the old position after a seek. The consumer skips it instead of playing it.
+void AudioRing::Discard()
+{
+	discardPosition.store(tail.load(std::memory_order_relaxed), std::memory_order_release);
+}
+
+/**
+ * Takes up to count samples out, after skipping the discarded ones.
+ *
+ * @return the number of samples that were read.
+ */
+unsigned int AudioRing::Read(float* output, unsigned int count)
+{
+	if (samples.empty())
+	{
+		return 0;
+	}
+
+	DropDiscarded();
+
+	uint64_t readIndex = head.load(std::memory_order_relaxed);
+	count = std::min(count, (unsigned int)(tail.load(std::memory_order_acquire) - readIndex));
+
+	unsigned int offset = (unsigned int)readIndex & mask;
+	unsigned int first = std::min(count, Capacity() - offset);
+	memcpy(output, &samples[offset], first * sizeof(float));
+	memcpy(output + first, &samples[0], (count - first) * sizeof(float));
+
+	head.store(readIndex + count, std::memory_order_release);
+	return count;
+}
+
+/**
+ * Records the presentation time of the sample that is written next, the
+ * samples before it are assumed to be continuous.
+ *
+ * @param serial  tells the consumer which seek the time belongs to
+ */
+void AudioRing::MarkTime(double time, int serial)
+{
+	markSequence++;
+	markPosition = tail.load(std::memory_order_relaxed);
+	markTime = time;
+	markSerial = serial;
+	markSequence++;
+}
+
+/**
+ * The presentation time of the sample that is read next, counted back from
+ * the last mark.
+ *
+ * @param samplesPerSecond  interleaved samples per second of the stream, the sample rate times the channel
+ *                          count divided by the playback speed
+ *
+ * @return false if the producer is updating the mark right now, or there is no mark for the read position.
+ */
+bool AudioRing::GetReadTime(double samplesPerSecond, double* time, int* serial)
+{
+	unsigned int sequence = markSequence;
+	if ((sequence & 1) != 0 || samplesPerSecond <= 0)
+	{
+		return false;
+	}
+
+	uint64_t position = markPosition;
+	double markedTime = markTime;
+	int markedSerial = markSerial;
+	if (markSequence != sequence)
+	{
+		return false;
+	}
+
+	uint64_t readIndex = head.load(std::memory_order_relaxed);
+	if (position < readIndex)
+	{
+		return false;
+	}
+
+	*time = markedTime - (double)(position - readIndex) / samplesPerSecond;
+	*serial = markedSerial;
+	return true;
+}
+
+//	Frees the room taken by discarded samples. Returns true if there were any.
+bool AudioRing::DropDiscarded()
+{
+	uint64_t readIndex = head.load(std::memory_order_relaxed);
+	uint64_t discardIndex = discardPosition.load(std::memory_order_acquire);
+	if (discardIndex <= readIndex)
+	{
+		return false;
+	}
+
+	head.store(discardIndex, std::memory_order_release);
+	return true;
+}
+
+//	A snapshot, the other side may write or read at any moment.
+unsigned int AudioRing::Size()
+{
+	return (unsigned int)(tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire));
+}
+
+unsigned int AudioRing::Space()
+{
+	return Capacity() - Size();
+}
+
+unsigned int AudioRing::Capacity()
+{
+	return samples.empty() ? 0 : mask + 1;
+}
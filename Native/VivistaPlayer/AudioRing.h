@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Interleaved float samples on their way from the audio decoder task to the
+ * thread that plays them.
+ *
+ * Single producer, single consumer. Write(), Discard() and MarkTime() may
+ * only be called from the producer, Read(), DropDiscarded() and
+ * GetReadTime() only from the consumer.
+ * Neither side locks or allocates. Init() reallocates the storage and may
+ * only be called while neither side uses the ring.
+ */
+class AudioRing
+{
+public:
+	AudioRing();
+
+	void Init(unsigned int capacity);
+
+	unsigned int Write(const float* samples, unsigned int count);
+	void Discard();
+	void MarkTime(double time, int serial);
+
+	unsigned int Read(float* samples, unsigned int count);
+	bool DropDiscarded();
+	bool GetReadTime(double samplesPerSecond, double* time, int* serial);
+
+	unsigned int Size();
+	unsigned int Space();
+	unsigned int Capacity();
+
+private:
+	std::vector<float>			samples;
+	unsigned int				mask;
+
+	//	Positions count samples since Init(). 64 bits never wrap, so a discard position that was already
+	//	passed can't come out ahead of the read position again.
+	alignas(64) std::atomic<uint64_t>	head;
+	alignas(64) std::atomic<uint64_t>	tail;
+	std::atomic<uint64_t>		discardPosition;
+
+	//	The pts of the write position, guarded by a sequence number that is odd while the producer updates it.
+	std::atomic<unsigned int>	markSequence;
+	std::atomic<uint64_t>		markPosition;
+	std::atomic<double>			markTime;
+	std::atomic<int>			markSerial;
+};
@@ -0,0 +1,81 @@
+#include "Clock.h"
+
+#include <chrono>
+
+Clock::Clock()
+{
+	writeLock.clear();
+	sequence = 0;
+	pts = 0.0;
+	time = 0.0;
+	speed = 1.0;
+	serial = -1;
+}
+
+//	The clock reads pts at the given time, which is usually Now().
+void Clock::Set(double pts, int serial, double time)
+{
+	BeginWrite();
+	this->pts = pts;
+	this->time = time;
+	this->serial = serial;
+	EndWrite();
+}
+
+//	Continues from the current reading at the new speed, so changing it doesn't make the clock jump.
+void Clock::SetSpeed(double speed, double time)
+{
+	BeginWrite();
+	double current = pts + (time - this->time) * this->speed;
+	pts = current;
+	this->time = time;
+	this->speed = speed;
+	EndWrite();
+}
+
+//	Returns -1 if the clock was not set since the given serial.
+double Clock::Get(int serial, double time)
+{
+	while (true)
+	{
+		unsigned int start = sequence;
+		if ((start & 1) != 0)
+		{
+			continue;
+		}
+
+		int setSerial = this->serial;
+		double value = pts + (time - this->time) * speed;
+		if (sequence != start)
+		{
+			continue;
+		}
+
+		return setSerial == serial ? value : -1;
+	}
+}
+
+double Clock::GetSpeed()
+{
+	return speed;
+}
+
+//	Seconds on a monotonic clock. A double keeps microsecond precision for centuries, unlike the float time from Unity.
+double Clock::Now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Clock::BeginWrite()
+{
+	while (writeLock.test_and_set(std::memory_order_acquire))
+	{
+	}
+	sequence++;
+}
+
+void Clock::EndWrite()
+{
+	sequence++;
+	writeLock.clear(std::memory_order_release);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <atomic>
+
+/**
+ * A presentation clock like the audio, video and external clocks of ffplay.
+ * It is set to a pts at a point in time and runs from there at its speed.
+ *
+ * Every value carries the serial it was set with. The decoder bumps its
+ * serial at each seek, and Get() ignores values from before that, so the
+ * clock of the old position is never mistaken for the new one.
+ *
+ * Get() never locks. The pts, time and speed belong together, so writers
+ * bump a sequence number around their update and readers retry when it
+ * changed underneath them. Writers exclude each other with a spin lock,
+ * they only hold it for a few stores.
+ */
+class Clock
+{
+public:
+	Clock();
+
+	void Set(double pts, int serial, double time);
+	void SetSpeed(double speed, double time);
+	double Get(int serial, double time);
+	double GetSpeed();
+
+	static double Now();
+
+private:
+	std::atomic_flag			writeLock;
+	std::atomic<unsigned int>	sequence;
+	std::atomic<double>			pts;
+	std::atomic<double>			time;
+	std::atomic<double>			speed;
+	std::atomic<int>			serial;
+
+	void BeginWrite();
+	void EndWrite();
+};
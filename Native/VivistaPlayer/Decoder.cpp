@@ -1,10 +1,93 @@
 #include <fstream>
 #include <string>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
 
 #include "Decoder.h"
 #include "Logger.h"
+#include "ThreadUtil.h"
+#include "ProbeCache.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+#include <libavfilter/buffersrc.h>
+#include <libavfilter/buffersink.h>
+}
+
+// Upper bounds for the demuxed packets that are waiting for their decoder task.
+static const int MAX_VIDEOQ_SIZE = 15 * 1024 * 1024;
+static const int MAX_VIDEOQ_COUNT = 256;
+static const int MAX_AUDIOQ_SIZE = 1024 * 1024;
+static const int MAX_AUDIOQ_COUNT = 256;
+
+// Hard upper bound of the decoded video frame buffer, videoBuffMax has to stay below it.
+static const unsigned int FRAME_RING_CAPACITY = 256;
+
+// Decoded frames are buffered until either limit is reached, unless SetBufferLimits() says otherwise.
+static const int64_t DEFAULT_BUFFER_BYTES = 256 * 1024 * 1024;
+static const double DEFAULT_BUFFER_SECONDS = 1.0;
+static const unsigned int MIN_VIDEO_FRAMES = 3;
+static const unsigned int MIN_AUDIO_FRAMES = 4;
+// Samples that are converted to a different channel count go through a buffer of this size on the stack.
+static const unsigned int AUDIO_REMAP_SAMPLES = 1024;
+
+// A frame is late when its display time has already passed. After this many late frames in a row the decoder
+// starts skipping work, and after the recover count of frames in time it goes back one level.
+static const int SKIP_ESCALATE_FRAMES = 15;
+static const int SKIP_RECOVER_FRAMES = 120;
+static const AVDiscard SKIP_FRAME[] = { AVDISCARD_DEFAULT, AVDISCARD_NONREF, AVDISCARD_BIDIR };
+static const AVDiscard SKIP_LOOP_FILTER[] = { AVDISCARD_DEFAULT, AVDISCARD_NONREF, AVDISCARD_ALL };
+// Even when everything is late, keep one frame out of this many so the picture doesn't freeze.
+static const int MAX_CONSECUTIVE_DROPS = 8;
+
+// A frame shown later than this restarts the video clock instead of being caught up with. Smaller jumps
+// of the audio clock are smoothed out with the weight below, its time jitters with the device buffer.
+static const double SYNC_THRESHOLD_MAX = 0.1;
+static const double AUDIO_CLOCK_SMOOTHING = 0.1;
+// Clocks further apart than this are not corrected but set, as in main.c.
+static const double NOSYNC_THRESHOLD = 1.0;
+// The audio follows another master by resampling frames by at most this percentage, after averaging
+// the difference over this many frames.
+static const int SAMPLE_CORRECTION_PERCENT_MAX = 10;
+static const int AUDIO_DIFF_AVG_NB = 20;
+static const double AUDIO_DIFF_AVG_COEF = exp(log(0.01) / AUDIO_DIFF_AVG_NB);
+
+// Range of the playback speed. Above the fast speed the video decoder skips the non-reference frames right away,
+// decoding all of them would take several times the work of normal playback.
+static const double MIN_PLAYBACK_SPEED = 0.25;
+static const double MAX_PLAYBACK_SPEED = 4.0;
+static const double FAST_PLAYBACK_SPEED = 1.5;
+// A single atempo filter takes speeds in this range, others are chained.
+static const double MIN_ATEMPO = 0.5;
+static const double MAX_ATEMPO = 2.0;
+
+//	Plain files on a local disk. Network protocols and UNC shares would be read a second time just for the index.
+static bool IsLocalPath(const char* filePath)
+{
+	const char* protocol = avio_find_protocol_name(filePath);
+	if (protocol == NULL || strcmp(protocol, "file") != 0)
+	{
+		return false;
+	}
+
+	if (strncmp(filePath, "file:", 5) == 0)
+	{
+		filePath += 5;
+	}
+
+	return !((filePath[0] == '\\' || filePath[0] == '/') && filePath[0] == filePath[1]);
+}
 
 Decoder::Decoder()
+	: videoFrames(FRAME_RING_CAPACITY),
+	allocationCount(0),
+	videoFramePool(FRAME_RING_CAPACITY, &allocationCount),
+	videoBufferPool(&allocationCount),
+	convertBufferPool(&allocationCount)
 {
 	inputContext = NULL;
 	videoStreamIndex = 0;
@@ -16,21 +99,82 @@ Decoder::Decoder()
 	videoCodecContext = NULL;
 	audioCodecContext = NULL;
 	av_init_packet(&packet);
+	audioDecodeFrame = av_frame_alloc();
 
 	swrContext = NULL;
+	audioOutputRate = 0;
+	audioStepSamples = 0;
+	isAudioPulled = false;
+	isAudioDrained = false;
+	audioUnderruns = 0;
+	audioOverruns = 0;
+	audioFilterGraph = NULL;
+	audioFilterSource = NULL;
+	audioFilterSink = NULL;
+	audioFilterInput = av_frame_alloc();
+	audioFilterOutput = av_frame_alloc();
+	audioFilterSpeed = 1.0;
+	audioFilterDelay = 0;
+	audioFilterSamples = 0;
 
 	videoBuffMax = 64;
-	audioBuffMax = 128;
+	buffMaxBytes = DEFAULT_BUFFER_BYTES;
+	buffMaxSeconds = DEFAULT_BUFFER_SECONDS;
+
+	videoPackets.Init(MAX_VIDEOQ_SIZE, MAX_VIDEOQ_COUNT);
+	audioPackets.Init(MAX_AUDIOQ_SIZE, MAX_AUDIOQ_COUNT);
+	videoPackets.SetConsumer(&videoTask);
+	audioPackets.SetConsumer(&audioTask);
+	isDecoding = false;
+	demuxTask = NULL;
+	av_init_packet(&videoPacket);
+	videoPacketSerial = 0;
+	isVideoPacketPending = false;
+
+	syncMaster = SYNC_AUDIO;
+	clockSerial = 0;
+	playbackSpeed = 1.0;
+	audioDiffCum = 0;
+	audioDiffAvgCount = 0;
+	audioWritePts = 0;
+	videoNextPts = AV_NOPTS_VALUE;
+	swsContext = NULL;
+	convertedFrames = 0;
+	convertSeconds = 0.0;
+	lastConvertSeconds = 0.0;
+	isLooping = false;
+	loopStartTime = 0.0;
+	ResetLoop();
+
+	droppedFrames = 0;
+	skippedFrames = 0;
+	skipLevel = 0;
+	lateFrames = 0;
+	onTimeFrames = 0;
+	consecutiveDrops = 0;
+	packetsInCodec = 0;
+
+	seekTarget = -1;
+	seekGeneration = 0;
+	completedSeekGeneration = 0;
+	videoSeekGeneration = 0;
+	videoSeekPts = AV_NOPTS_VALUE;
+	videoFrameDuration = 0;
+	isIndexAborted = false;
 
 	videoInfo = {};
 	audioInfo = {};
+	threadingConfig = {};
 	isInitialized = false;
 	isAudioAllChEnabled = false;
 	useTCP = false;
+	isFastOpen = false;
 }
 
 Decoder::~Decoder()
 {
+	Stop();
+
 	if (videoCodecContext != NULL)
 	{
 		avcodec_close(videoCodecContext);
@@ -57,8 +201,14 @@ Decoder::~Decoder()
 		swrContext = NULL;
 	}
 
-	FlushBuffer(&videoFrames, &videoMutex);
-	FlushBuffer(&audioFrames, &audioMutex);
+	sws_freeContext(swsContext);
+	swsContext = NULL;
+
+	FlushBuffer(&videoFrames);
+	av_frame_free(&audioDecodeFrame);
+	FreeAudioFilter();
+	av_frame_free(&audioFilterInput);
+	av_frame_free(&audioFilterOutput);
 
 	videoCodec = NULL;
 	audioCodec = NULL;
@@ -66,6 +216,36 @@ Decoder::~Decoder()
 	videoStream = NULL;
 	audioStream = NULL;
 	av_packet_unref(&packet);
+	av_packet_unref(&videoPacket);
+}
+
+//	Only has an effect before Init(), that is where the codecs are opened.
+void Decoder::SetThreadingConfig(ThreadingConfig config)
+{
+	threadingConfig = config;
+}
+
+//	Lets Init skip stream probing when it can, see ProbeCache. Has to be called before Init().
+void Decoder::SetFastOpen(bool isEnabled)
+{
+	isFastOpen = isEnabled;
+}
+
+/**
+ * Only has an effect before Init().
+ *
+ * @param sampleRate     the rate of the audio device, 0 keeps the rate of the stream
+ * @param isAllChannels  keeps every channel, e.g. for ambisonics, instead of downmixing to stereo
+ */
+void Decoder::SetAudioOutput(int sampleRate, bool isAllChannels)
+{
+	audioOutputRate = sampleRate;
+	isAudioAllChEnabled = isAllChannels;
+}
+
+Decoder::ThreadingConfig Decoder::GetThreadingConfig()
+{
+	return threadingConfig;
 }
 
 bool Decoder::Init(const char* filePath)
@@ -103,11 +283,22 @@ bool Decoder::Init(const char* filePath)
 		return false;
 	}
 
-	errorCode = avformat_find_stream_info(inputContext, NULL);
-	if (errorCode < 0)
+	//	Probing reads and decodes the start of every stream, which is slow on network shares.
+	//	In fast open mode it is skipped when an earlier open left its results in the cache, or when the header has all we need.
+	bool isProbed = isFastOpen && (ProbeCache::Load(filePath, inputContext) || ProbeCache::IsHeaderSufficient(inputContext));
+	if (!isProbed)
 	{
-		LOG("avformat_find_stream_info error(%x). \n", errorCode);
-		return false;
+		errorCode = avformat_find_stream_info(inputContext, NULL);
+		if (errorCode < 0)
+		{
+			LOG("avformat_find_stream_info error(%x). \n", errorCode);
+			return false;
+		}
+
+		if (isFastOpen)
+		{
+			ProbeCache::Save(filePath, inputContext);
+		}
 	}
 
 	ctxDuration = (double)(inputContext->duration) / AV_TIME_BASE;
@@ -135,9 +326,33 @@ bool Decoder::Init(const char* filePath)
 		errorCode = avcodec_parameters_to_context(videoCodecContext, inputContext->streams[videoStreamIndex]->codecpar);
 		if (errorCode < 0) { return false; }
 
+		//	Picture buffers come from a pool sized for this stream, so steady-state playback doesn't allocate.
+		videoBufferPool.Attach(videoCodecContext);
+
 		AVDictionary* autoThread = nullptr;
-		av_dict_set(&autoThread, "threads", "auto", 0);
+		if (threadingConfig.videoThreadCount <= 0)
+		{
+			av_dict_set(&autoThread, "threads", "auto", 0);
+		}
+		else
+		{
+			videoCodecContext->thread_count = threadingConfig.videoThreadCount;
+		}
+
+		if (threadingConfig.videoThreadType != THREAD_DEFAULT)
+		{
+			videoCodecContext->thread_type = threadingConfig.videoThreadType;
+		}
+
+		//	The codec creates its worker threads here. They inherit the affinity of this thread on Linux and Android,
+		//	so pin it for the duration of the open. Windows threads don't inherit it, there only our own threads are pinned.
+		uint64_t previousAffinity = 0;
+		bool isPinned = SetCurrentThreadAffinity(threadingConfig.videoAffinity, &previousAffinity);
 		errorCode = avcodec_open2(videoCodecContext, videoCodec, &autoThread);
+		if (isPinned)
+		{
+			SetCurrentThreadAffinity(previousAffinity);
+		}
 		av_dict_free(&autoThread);
 		if (errorCode < 0) { return false; }
 
@@ -145,8 +360,6 @@ bool Decoder::Init(const char* filePath)
 		videoInfo.width = videoCodecContext->width;
 		videoInfo.height = videoCodecContext->height;
 		videoInfo.totalTime = videoStream->duration <= 0 ? ctxDuration : videoStream->duration * av_q2d(videoStream->time_base);
-
-		videoFrames.swap(decltype(videoFrames)());
 	}
 
 
@@ -172,7 +385,18 @@ bool Decoder::Init(const char* filePath)
 		errorCode = avcodec_parameters_to_context(audioCodecContext, inputContext->streams[audioStreamIndex]->codecpar);
 		if (errorCode < 0) { return false; }
 
+		if (threadingConfig.audioThreadCount > 0)
+		{
+			audioCodecContext->thread_count = threadingConfig.audioThreadCount;
+		}
+
+		uint64_t previousAffinity = 0;
+		bool isPinned = SetCurrentThreadAffinity(threadingConfig.audioAffinity, &previousAffinity);
 		errorCode = avcodec_open2(audioCodecContext, audioCodec, NULL);
+		if (isPinned)
+		{
+			SetCurrentThreadAffinity(previousAffinity);
+		}
 		if (errorCode < 0) { return false; }
 
 		int64_t inChannelLayout = av_get_default_channel_layout(audioCodecContext->channels);
@@ -180,7 +404,7 @@ bool Decoder::Init(const char* filePath)
 		AVSampleFormat inSampleFormat = audioCodecContext->sample_fmt;
 		AVSampleFormat outSampleFormat = AV_SAMPLE_FMT_FLT;
 		int inSampleRate = audioCodecContext->sample_rate;
-		int outSampleRate = inSampleRate;
+		int outSampleRate = audioOutputRate > 0 ? audioOutputRate : inSampleRate;
 
 		if (swrContext != NULL)
 		{
@@ -205,8 +429,23 @@ bool Decoder::Init(const char* filePath)
 		audioInfo.channels = av_get_channel_layout_nb_channels(outChannelLayout);
 		audioInfo.sampleRate = outSampleRate;
 		audioInfo.totalTime = audioStream->duration <= 0 ? (double)(inputContext->duration) / AV_TIME_BASE : audioStream->duration * av_q2d(audioStream->time_base);;
+	}
+
+	UpdateBufferLimits();
 
-		audioFrames.swap(decltype(audioFrames)());
+	//	Only formats that are seeked by byte get an index of their own, the others keep one in their container
+	//	(index_entries) or find the keyframe by time well enough. Scanning a long file takes a while, so that
+	//	happens in the background.
+	if (videoInfo.isEnabled && (inputContext->iformat->flags & AVFMT_TS_DISCONT) && IsLocalPath(filePath))
+	{
+		std::string path = filePath;
+		int streamIndex = videoStreamIndex;
+		indexThread = std::thread([this, path, streamIndex]() {
+			if (!keyframeIndex.Load(path.c_str(), streamIndex))
+			{
+				keyframeIndex.Build(path.c_str(), streamIndex, &isIndexAborted);
+			}
+		});
 	}
 
 	isInitialized = true;
@@ -214,288 +453,1611 @@ bool Decoder::Init(const char* filePath)
 	return true;
 }
 
-bool Decoder::Decode()
+/**
+ * Limits how much decoded media is buffered ahead, both in bytes of decoded
+ * frames and in seconds of playback. Has to be called before Start().
+ *
+ * @param maxBytes    <= 0 keeps the default
+ * @param maxSeconds  <= 0 keeps the default
+ */
+void Decoder::SetBufferLimits(int64_t maxBytes, double maxSeconds)
+{
+	if (isDecoding)
+	{
+		return;
+	}
+
+	buffMaxBytes = maxBytes > 0 ? maxBytes : DEFAULT_BUFFER_BYTES;
+	buffMaxSeconds = maxSeconds > 0 ? maxSeconds : DEFAULT_BUFFER_SECONDS;
+
+	if (isInitialized)
+	{
+		UpdateBufferLimits();
+	}
+}
+
+void Decoder::Start()
+{
+	if (!isInitialized || isDecoding)
+	{
+		return;
+	}
+
+	isDecoding = true;
+
+	if (videoInfo.isEnabled)
+	{
+		videoPackets.Start();
+		videoTask.Start([this] { return VideoDecodeStep(); });
+	}
+
+	if (audioInfo.isEnabled)
+	{
+		audioPackets.Start();
+		audioTask.Start([this] { return AudioDecodeStep(); });
+	}
+}
+
+void Decoder::Stop()
+{
+	//	Aborting the packet queues wakes the decoder tasks, they see isDecoding and finish.
+	isDecoding = false;
+	videoPackets.Abort();
+	audioPackets.Abort();
+	WakeDemux();
+
+	videoTask.Join();
+	audioTask.Join();
+
+	isIndexAborted = true;
+	if (indexThread.joinable())
+	{
+		indexThread.join();
+	}
+}
+
+/**
+ * The demux stage. Reads one packet from the input and hands it to the
+ * packet queue of its stream, the decoder tasks take it from there.
+ * Never waits, while the packet queues are full it reads nothing.
+ *
+ * @return DEMUX_BLOCKED if the packet queues are full, DEMUX_END when the end of the input is reached.
+ */
+int Decoder::Demux()
 {
 	if (!isInitialized)
 	{
-		return false;
+		return DEMUX_END;
+	}
+
+	if (IsBuffBlocked())
+	{
+		return DEMUX_BLOCKED;
 	}
 
-	if (!IsBuffBlocked())
+	int errorCode = av_read_frame(inputContext, &packet);
+	if (errorCode < 0)
 	{
-		if (int errorCode = av_read_frame(inputContext, &packet) < 0)
+		//	Looping goes on with the next iteration right away, the decoder tasks never see the end.
+		bool isEnd = errorCode == AVERROR_EOF || (inputContext->pb != NULL && avio_feof(inputContext->pb));
+		if (isLooping && isEnd && LoopInput())
 		{
-			return false;
+			return DEMUX_PACKET;
 		}
 
-		if (videoInfo.isEnabled && packet.stream_index == videoStream->index)
+		//	Let the decoder tasks drain the frames their codecs are still holding on to.
+		if (videoInfo.isEnabled)
 		{
-			UpdateVideoFrame();
+			videoPackets.PutNullPacket();
 		}
-		else if (audioInfo.isEnabled && packet.stream_index == audioStream->index)
+
+		if (audioInfo.isEnabled)
 		{
-			//UpdateAudioFrame();
+			audioPackets.PutNullPacket();
 		}
 
-		av_packet_unref(&packet);
+		return DEMUX_END;
 	}
 
-	return true;
+	OffsetLoopPacket(&packet);
+
+	if (videoInfo.isEnabled && packet.stream_index == videoStream->index)
+	{
+		videoPackets.Put(&packet);
+	}
+	else if (audioInfo.isEnabled && packet.stream_index == audioStream->index)
+	{
+		audioPackets.Put(&packet);
+	}
+
+	av_packet_unref(&packet);
+
+	return DEMUX_PACKET;
 }
 
-void Decoder::Seek(double time)
+//	The task that calls Demux(), it is woken whenever a packet queue gets room.
+void Decoder::SetDemuxTask(Scheduler::Task* task)
+{
+	demuxTask = task;
+}
+
+//	Decoder tasks of players with a higher priority are run first when the scheduler is busy.
+void Decoder::SetPriority(Scheduler::Priority priority)
+{
+	videoTask.SetPriority(priority);
+	audioTask.SetPriority(priority);
+}
+
+/**
+ * Moves the demuxer to the given time and flushes the decoder tasks.
+ *
+ * @param   generation  identifies this seek, GetSeekGeneration() returns it once the frame at the target is queued.
+ *                      A newer seek abandons the decoding towards the target of an older one.
+ */
+void Decoder::Seek(double time, int generation)
 {
 	if (!isInitialized)
 	{
+		CompleteSeek(generation);
 		return;
 	}
 
-	uint64_t timeStamp = (uint64_t)time * AV_TIME_BASE;
+	//	Land on the keyframe at or before the target, the video thread decodes from there up to the exact frame.
+	int64_t timeStamp = (int64_t)(time * AV_TIME_BASE);
 
-	if (av_seek_frame(inputContext, -1, timeStamp, AVSEEK_FLAG_BACKWARD) < 0)
+	if (!SeekToKeyframe(timeStamp) && avformat_seek_file(inputContext, -1, INT64_MIN, timeStamp, timeStamp, 0) < 0)
 	{
+		CompleteSeek(generation);
 		return;
 	}
 
+	//	The target is a time in the file, the timestamps after it are no longer moved by earlier loops.
+	ResetLoop();
+
+	//	The codecs belong to the decoder tasks, they flush them when they get to the flush packet.
+	//	Frames that are still buffered have an old serial now and get dropped by the consumer.
 	if (videoInfo.isEnabled)
 	{
-		if (videoCodecContext != NULL)
 		{
-			avcodec_flush_buffers(videoCodecContext);
+			std::lock_guard<std::mutex> lock(seekMutex);
+			seekTarget = time;
+			seekGeneration = generation;
 		}
-		FlushBuffer(&videoFrames, &videoMutex);
+		videoPackets.PutFlush();
 		videoInfo.lastTime = -1;
 	}
 
 	if (audioInfo.isEnabled)
 	{
-		if (audioCodecContext != NULL)
-		{
-			avcodec_flush_buffers(audioCodecContext);
-		}
-		FlushBuffer(&audioFrames, &audioMutex);
+		audioPackets.PutFlush();
 		audioInfo.lastTime = -1;
 	}
-}
-
-void Decoder::StreamComponentOpen()
-{
 
-}
+	//	After the flushes, so a thread that sees the new clock serial can't take a frame from before the seek for current.
+	clockSerial++;
 
-Decoder::VideoInfo Decoder::GetVideoInfo()
-{
-	return videoInfo;
+	//	Without video there is no target frame to wait for.
+	if (!videoInfo.isEnabled)
+	{
+		CompleteSeek(generation);
+	}
 }
 
-Decoder::AudioInfo Decoder::GetAudioInfo()
+/**
+ * Seeks straight to the keyframe at or before the target. Containers with an
+ * index (MP4, MKV with cues) list their keyframes in index_entries, asking for
+ * the exact pts of one saves the demuxer from searching around the target.
+ * MPEG-TS and MPEG-PS have none, they can start reading at any byte, so there
+ * the keyframe index jumps to the byte position, once it is ready.
+ *
+ * @return false if neither index can be used, the caller seeks by time then.
+ */
+bool Decoder::SeekToKeyframe(int64_t timeStamp)
 {
-	return audioInfo;
-}
+	if (!videoInfo.isEnabled)
+	{
+		return false;
+	}
 
-double Decoder::GetVideoFrame(unsigned char** outputY, unsigned char** outputU, unsigned char** outputV)
-{
-	std::lock_guard<std::mutex> lock(videoMutex);
+	int64_t pts = av_rescale_q(timeStamp, AV_TIME_BASE_Q, videoStream->time_base);
 
-	if (!isInitialized || videoFrames.size() == 0)
+	if (videoStream->nb_index_entries > 0)
 	{
-		*outputY = *outputU = *outputV = NULL;
-		return -1;
+		//	Without AVSEEK_FLAG_ANY only keyframes are found.
+		int entry = av_index_search_timestamp(videoStream, pts, AVSEEK_FLAG_BACKWARD);
+		if (entry < 0)
+		{
+			return false;
+		}
+
+		int64_t keyframePts = videoStream->index_entries[entry].timestamp;
+		return avformat_seek_file(inputContext, videoStreamIndex, INT64_MIN, keyframePts, keyframePts, 0) >= 0;
 	}
 
-	AVFrame* frame = videoFrames.front();
-	*outputY = frame->data[0];
-	*outputU = frame->data[1];
-	*outputV = frame->data[2];
-	// PTS
-	int64_t timeStamp = frame->best_effort_timestamp;
-	double timeInSec = av_q2d(videoStream->time_base) * timeStamp;
-	videoInfo.lastTime = timeInSec;
+	KeyframeIndex::Keyframe keyframe;
+	if (!(inputContext->iformat->flags & AVFMT_TS_DISCONT) || !keyframeIndex.Find(pts, &keyframe) || keyframe.pos < 0)
+	{
+		return false;
+	}
 
-	return timeInSec;
+	return av_seek_frame(inputContext, videoStreamIndex, keyframe.pos, AVSEEK_FLAG_BYTE) >= 0;
 }
 
-double Decoder::GetAudioFrame(unsigned char** outputFrame, int& frameSize)
+/**
+ * Moves the input back to the loop start when it runs out. The frames of the
+ * old iteration that are still buffered are shown while the next one is
+ * decoded, nothing is flushed. The loop starts at the keyframe at or before
+ * the loop start.
+ *
+ * @return false if nothing was read since the last loop or seeking failed, the stream ends normally then.
+ */
+bool Decoder::LoopInput()
 {
-	std::lock_guard<std::mutex> lock(audioMutex);
-	if (!isInitialized || audioFrames.size() == 0)
+	if (loopIterationEnd == AV_NOPTS_VALUE)
 	{
-		*outputFrame = NULL;
-		return -1;
+		return false;
 	}
 
-	AVFrame* frame = audioFrames.front();
-	*outputFrame = frame->data[0];
-	frameSize = frame->nb_samples;
-	int64_t timeStamp = 0;
-	//int64_t timeStamp = av_frame_get_best_effort_timestamp(frame);
-	double timeInSec = av_q2d(audioStream->time_base) * timeStamp;
-	audioInfo.lastTime = timeInSec;
+	int64_t timeStamp = (int64_t)(loopStartTime * AV_TIME_BASE);
+	if (!SeekToKeyframe(timeStamp) && avformat_seek_file(inputContext, -1, INT64_MIN, timeStamp, timeStamp, 0) < 0)
+	{
+		LOG("Seeking to the loop start failed. \n");
+		return false;
+	}
 
-	return timeInSec;
+	//	Where the first packet of the next iteration is shown. Its offset is only known once that packet is read.
+	loopNextStart = loopIterationEnd + loopOffset;
+	loopIterationEnd = AV_NOPTS_VALUE;
+	isLoopStartPending = true;
+	return true;
 }
 
-void Decoder::EnableVideo(bool isEnabled)
+//	Moves the timestamps of a packet by the offset of its iteration, and keeps track of where the iteration ends.
+void Decoder::OffsetLoopPacket(AVPacket* packet)
 {
-	if (videoStream == NULL)
+	AVStream* stream = inputContext->streams[packet->stream_index];
+	int64_t start = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+	if (start == AV_NOPTS_VALUE)
 	{
 		return;
 	}
 
-	videoInfo.isEnabled = isEnabled;
-}
+	if (isLoopStartPending)
+	{
+		loopOffset = loopNextStart - av_rescale_q(start, stream->time_base, AV_TIME_BASE_Q);
+		isLoopStartPending = false;
+	}
 
-void Decoder::EnableAudio(bool isEnabled)
-{
-	if (audioStream == NULL)
+	//	Without a duration the last video frame would overlap with the first one of the next iteration and be skipped.
+	int64_t duration = packet->duration;
+	if (duration <= 0 && stream == videoStream)
 	{
-		return;
+		AVRational frameRate = av_guess_frame_rate(inputContext, videoStream, NULL);
+		duration = frameRate.num > 0 && frameRate.den > 0 ? av_rescale_q(1, av_inv_q(frameRate), stream->time_base) : 0;
 	}
 
-	audioInfo.isEnabled = isEnabled;
+	int64_t end = av_rescale_q(start + std::max(duration, (int64_t)0), stream->time_base, AV_TIME_BASE_Q);
+	if (loopIterationEnd == AV_NOPTS_VALUE || end > loopIterationEnd)
+	{
+		loopIterationEnd = end;
+	}
+
+	if (loopOffset != 0)
+	{
+		int64_t offset = av_rescale_q(loopOffset, AV_TIME_BASE_Q, stream->time_base);
+		if (packet->pts != AV_NOPTS_VALUE)
+		{
+			packet->pts += offset;
+		}
+		if (packet->dts != AV_NOPTS_VALUE)
+		{
+			packet->dts += offset;
+		}
+	}
 }
 
-void Decoder::FreeVideoFrame()
+void Decoder::ResetLoop()
 {
-	FreeFrontFrame(&videoFrames, &videoMutex);
+	loopOffset = 0;
+	loopIterationEnd = AV_NOPTS_VALUE;
+	loopNextStart = 0;
+	isLoopStartPending = false;
 }
 
-void Decoder::FreeAudioFrame()
+//	The newest seek whose target frame is queued, or that ended up past the end of the stream.
+int Decoder::GetSeekGeneration()
 {
-	FreeFrontFrame(&audioFrames, &audioMutex);
+	return completedSeekGeneration;
 }
 
-void Decoder::UpdateBufferState()
+//	Makes a demux stage that is waiting for packet queue space return, e.g. because a seek or stop came in.
+void Decoder::WakeDemux()
 {
-	if (videoInfo.isEnabled)
+	if (demuxTask != NULL)
 	{
-		if (videoFrames.size() >= videoBuffMax)
-		{
-			videoInfo.bufferState = BufferState::FULL;
-		}
-		else if (videoFrames.size() == 0)
-		{
-			videoInfo.bufferState = BufferState::EMPTY;
-		}
-		else
-		{
-			videoInfo.bufferState = BufferState::NORMAL;
-		}
+		demuxTask->Wake();
 	}
+}
 
-	if (audioInfo.isEnabled)
-	{
-		if (audioFrames.size() >= audioBuffMax)
-		{
-			audioInfo.bufferState = BufferState::FULL;
-		}
-		else if (audioFrames.size() == 0)
-		{
-			audioInfo.bufferState = BufferState::EMPTY;
-		}
-		else
-		{
-			audioInfo.bufferState = BufferState::NORMAL;
-		}
-	}
+//	Can be changed while playing, the new master takes over from where the clocks are.
+void Decoder::SetSyncMaster(SyncMaster master)
+{
+	syncMaster = master;
 }
 
-bool Decoder::IsBuffBlocked()
+//	The requested master, unless its stream is missing. The audio only counts once the audio thread pulls it.
+Decoder::SyncMaster Decoder::GetSyncMaster()
 {
-	if (videoInfo.isEnabled && videoInfo.bufferState == BufferState::FULL)
+	SyncMaster master = (SyncMaster)(int)syncMaster;
+	if (master == SYNC_VIDEO && !videoInfo.isEnabled)
 	{
-		return true;
+		master = SYNC_AUDIO;
+	}
+	if (master == SYNC_AUDIO && (!audioInfo.isEnabled || !isAudioPulled))
+	{
+		master = SYNC_EXTERNAL;
 	}
 
-	if (audioInfo.isEnabled && audioInfo.bufferState == BufferState::FULL)
+	return master;
+}
+
+/**
+ * The time that should be on screen right now, in seconds. Frames that are
+ * past it are dropped. Until the master is set after a start or seek, the
+ * external clock stands in for it.
+ *
+ * @return -1 before the first frame after a start or seek was shown.
+ */
+double Decoder::GetMasterClock()
+{
+	int serial = clockSerial;
+	double now = Clock::Now();
+	double time = -1;
+
+	switch (GetSyncMaster())
 	{
-		return true;
+		case SYNC_AUDIO:
+			time = audioClock.Get(serial, now);
+			break;
+		case SYNC_VIDEO:
+			time = videoClock.Get(serial, now);
+			break;
+		default:
+			break;
 	}
 
-	return false;
+	return time >= 0 ? time : externalClock.Get(serial, now);
 }
 
 /**
- * This function is called for updating a video frame.
+ * Scales the presentation clocks, audio is time-stretched to match. Takes
+ * effect right away for the clocks and with the next decoded frame for the
+ * audio, what is already in the ring plays at the old speed.
  *
- * This thread reads in packets from the video queue, packet_queue_get(), decodes
- * the video packets into a frame, and then calls the queue_picture() function to
- * put the processed frame into the picture queue.
+ * @param speed  clamped to MIN_PLAYBACK_SPEED to MAX_PLAYBACK_SPEED
+ */
+void Decoder::SetPlaybackSpeed(double speed)
+{
+	speed = std::min(std::max(speed, MIN_PLAYBACK_SPEED), MAX_PLAYBACK_SPEED);
+	playbackSpeed = speed;
+
+	double now = Clock::Now();
+	audioClock.SetSpeed(speed, now);
+	videoClock.SetSpeed(speed, now);
+	externalClock.SetSpeed(speed, now);
+}
+
+/**
+ * Plays the video in a loop instead of ending. Has to be enabled before the
+ * demux stage reaches the end of the input.
  *
+ * @param startTime  where every iteration after the first starts, in seconds
  */
-void Decoder::UpdateVideoFrame()
+void Decoder::SetLoop(bool isEnabled, double startTime)
 {
-	AVFrame* frame = av_frame_alloc();
-	clock_t start = clock();
-	int errorCode = 0;
-	double pts;
-	
-	errorCode = avcodec_send_packet(videoCodecContext, &packet);
-	errorCode = avcodec_receive_frame(videoCodecContext, frame);
-
-	// TODO PTS
-
-	//if (avcodec_decode_video2(videoCodecContext, frame, &isFrameAvailable, &packet) < 0)
-	//{
-	//	return;
-	//}
-	printf("UpdateVideoFrame = %f\n", (float)(clock() - start) / CLOCKS_PER_SEC);
-	if (errorCode >= 0)
+	loopStartTime = std::max(startTime, 0.0);
+	isLooping = isEnabled;
+}
+
+//	Keeps the external clock close to the others, so it can stand in for them. It is only set when it is far off, like the clocks in main.c.
+void Decoder::SyncExternalClock(double pts, int serial, double time)
+{
+	double external = externalClock.Get(serial, time);
+	if (external < 0 || fabs(external - pts) > NOSYNC_THRESHOLD)
 	{
-		std::lock_guard<std::mutex> lock(videoMutex);
-		videoFrames.push(frame);
-		UpdateBufferState();
+		externalClock.Set(pts, serial, time);
 	}
 }
 
-void Decoder::UpdateAudioFrame()
+int Decoder::GetDroppedFrames()
 {
-	int isFrameAvailable = 0;
-	AVFrame* frameDecoded = av_frame_alloc();
-	int errorCode = 0;
+	return droppedFrames;
+}
+
+//	Frames the codec never output because of skip_frame.
+int Decoder::GetSkippedFrames()
+{
+	return skippedFrames;
+}
+
+//	Frames the video task converted to yuv420p, and the time that took in total and for the last one.
+void Decoder::GetConvertStats(int& convertedFrames, double& totalSeconds, double& lastSeconds)
+{
+	convertedFrames = this->convertedFrames;
+	totalSeconds = convertSeconds;
+	lastSeconds = lastConvertSeconds;
+}
+
+//	Number of AVFrames and picture buffers allocated so far, pooled ones are not counted again when reused.
+uint64_t Decoder::GetAllocationCount()
+{
+	return allocationCount;
+}
+
+//	CPU time consumed by the decoder tasks, in seconds.
+double Decoder::GetThreadCpuTime()
+{
+	return videoTask.GetCpuTime() + audioTask.GetCpuTime();
+}
+
+//	The same split by task. Audio filtering runs on the audio task, so a tempo change shows up there.
+void Decoder::GetTaskCpuTimes(double& videoSeconds, double& audioSeconds)
+{
+	videoSeconds = videoTask.GetCpuTime();
+	audioSeconds = audioTask.GetCpuTime();
+}
 
-	// TODO
-	errorCode = avcodec_receive_frame(audioCodecContext, frameDecoded);
+void Decoder::StreamComponentOpen()
+{
 
-	//if (avcodec_decode_audio4(audioCodecContext, frameDecoded, &isFrameAvailable, &packet) < 0)
-	//{
-	//	return;
-	//}
+}
 
-	AVFrame* frame = av_frame_alloc();
-	frame->sample_rate = frameDecoded->sample_rate;
-	frame->channel_layout = av_get_default_channel_layout(audioInfo.channels);
-	frame->format = AV_SAMPLE_FMT_FLT;	//	For Unity format.
-	frame->best_effort_timestamp = frameDecoded->best_effort_timestamp;
-	swr_convert_frame(swrContext, frame, frameDecoded);
+Decoder::VideoInfo Decoder::GetVideoInfo()
+{
+	VideoInfo info = videoInfo;
+	info.bufferState = GetBufferState(&videoFrames, videoBuffMax);
+	return info;
+}
+
+Decoder::AudioInfo Decoder::GetAudioInfo()
+{
+	AudioInfo info = audioInfo;
+	unsigned int size = audioRing.Size();
+	info.bufferState = size == 0 ? BufferState::EMPTY : audioRing.Space() < GetAudioStepSpace() ? BufferState::FULL : BufferState::NORMAL;
+	return info;
+}
+
+//	outputLinesize receives the pitch of the three planes, the decoder pads its rows however it likes.
+double Decoder::GetVideoFrame(unsigned char** outputY, unsigned char** outputU, unsigned char** outputV, int* outputLinesize)
+{
+	AVFrame* frame = isInitialized ? FrontFrame(&videoFrames, &videoFramePool, &videoPackets, &videoTask) : NULL;
+
+	if (frame == NULL)
+	{
+		*outputY = *outputU = *outputV = NULL;
+		return -1;
+	}
+
+	*outputY = frame->data[0];
+	*outputU = frame->data[1];
+	*outputV = frame->data[2];
+	outputLinesize[0] = frame->linesize[0];
+	outputLinesize[1] = frame->linesize[1];
+	outputLinesize[2] = frame->linesize[2];
+	double timeInSec = GetVideoFrameTime(frame);
+	videoInfo.lastTime = timeInSec;
+
+	return timeInSec;
+}
+
+/**
+ * Fills the buffer with interleaved float samples for the audio device. When
+ * the device has a different channel count, the channels are copied over in
+ * order and extra device channels stay silent. Whatever is missing is filled
+ * with silence. Audio thread only, never allocates or waits on the decoder.
+ *
+ * @param frameCount  samples per channel to fill
+ * @param channels    channels of the device
+ *
+ * @return the number of samples per channel that came from the stream.
+ */
+unsigned int Decoder::GetAudioSamples(float* samples, unsigned int frameCount, unsigned int channels)
+{
+	int serial = clockSerial;
+	unsigned int sourceChannels = audioInfo.isEnabled ? audioInfo.channels : 0;
+	unsigned int delivered = 0;
+	isAudioPulled = true;
+
+	if (channels == sourceChannels)
+	{
+		delivered = audioRing.Read(samples, frameCount * channels) / channels;
+	}
+	else if (sourceChannels > 0 && sourceChannels <= AUDIO_REMAP_SAMPLES)
+	{
+		float buffer[AUDIO_REMAP_SAMPLES];
+		unsigned int chunkFrames = AUDIO_REMAP_SAMPLES / sourceChannels;
+		while (delivered < frameCount)
+		{
+			unsigned int read = audioRing.Read(buffer, std::min(chunkFrames, frameCount - delivered) * sourceChannels) / sourceChannels;
+			if (read == 0)
+			{
+				break;
+			}
+
+			for (unsigned int i = 0; i < read; i++)
+			{
+				float* output = samples + (delivered + i) * channels;
+				for (unsigned int c = 0; c < channels; c++)
+				{
+					output[c] = c < sourceChannels ? buffer[i * sourceChannels + c] : 0.0f;
+				}
+			}
+			delivered += read;
+		}
+	}
+
+	memset(samples + delivered * channels, 0, (frameCount - delivered) * channels * sizeof(float));
+
+	if (delivered > 0)
+	{
+		UpdateAudioClock(delivered, frameCount, serial);
+	}
+
+	//	Running dry after the last samples of the stream is not an underrun.
+	if (delivered < frameCount && sourceChannels > 0 && !isAudioDrained)
+	{
+		audioUnderruns++;
+	}
+
+	//	Only a parked decoder task takes a lock to be queued again, and only when there is room for a whole frame.
+	if (audioRing.Space() >= GetAudioStepSpace())
+	{
+		audioTask.Wake();
+	}
+
+	return delivered;
+}
+
+/**
+ * Sets the audio clock from the read position of the ring. Unity plays the
+ * buffer it just got after the one that is playing right now, so the device
+ * is about a buffer behind the samples that were just delivered. Audio
+ * thread only.
+ */
+void Decoder::UpdateAudioClock(unsigned int delivered, unsigned int frameCount, int serial)
+{
+	double readTime;
+	int markSerial;
+	double speed = playbackSpeed;
+	if (!audioRing.GetReadTime((double)audioInfo.sampleRate * audioInfo.channels / speed, &readTime, &markSerial) || markSerial != audioPackets.GetSerial())
+	{
+		return;
+	}
+
+	double now = Clock::Now();
+	double pts = readTime - (double)(delivered + frameCount) / audioInfo.sampleRate * speed;
+
+	//	When a pull happens depends on the device, so the measured time jitters. Small differences only move the clock part of the way.
+	double current = audioClock.Get(serial, now);
+	if (current >= 0 && fabs(pts - current) < SYNC_THRESHOLD_MAX)
+	{
+		pts = current + (pts - current) * AUDIO_CLOCK_SMOOTHING;
+	}
+
+	audioClock.Set(pts, serial, now);
+	SyncExternalClock(pts, serial, now);
+	audioInfo.lastTime = pts;
+}
+
+//	Underruns count the pulls that came up short, overruns the decoded frames that didn't completely fit into the ring.
+void Decoder::GetAudioStats(int& underruns, int& overruns)
+{
+	underruns = audioUnderruns;
+	overruns = audioOverruns;
+}
+
+void Decoder::EnableVideo(bool isEnabled)
+{
+	if (videoStream == NULL)
+	{
+		return;
+	}
+
+	videoInfo.isEnabled = isEnabled;
+}
+
+void Decoder::EnableAudio(bool isEnabled)
+{
+	if (audioStream == NULL)
+	{
+		return;
+	}
+
+	audioInfo.isEnabled = isEnabled;
+}
+
+//	The front frame was shown, its pts is the video clock now. Render thread only.
+void Decoder::FreeVideoFrame()
+{
+	int serial = clockSerial;
+	QueuedFrame queued;
+	if (isInitialized && videoFrames.Front(&queued) && queued.serial == videoPackets.GetSerial())
+	{
+		UpdateVideoClock(GetVideoFrameTime(queued.frame), serial);
+	}
+
+	FreeFrontFrame(&videoFrames, &videoFramePool, &videoTask);
+}
+
+/**
+ * A frame shown a little after it was due keeps the schedule of the video
+ * clock, otherwise the wait for the next vsync would add up over time. After
+ * a stall the clock starts over at the frame, so a video master never drops
+ * frames to catch up but slows down instead.
+ */
+void Decoder::UpdateVideoClock(double pts, int serial)
+{
+	double now = Clock::Now();
+	double current = videoClock.Get(serial, now);
+	double lateness = current - pts;
+	if (current < 0 || lateness < 0 || lateness > SYNC_THRESHOLD_MAX)
+	{
+		lateness = 0;
+	}
+
+	videoClock.Set(pts, serial, now - lateness);
+	SyncExternalClock(pts, serial, now - lateness);
+}
+
+/**
+ * Releases every queued video frame that is followed by a frame which is
+ * also due at the given time, so the front frame is the newest one that
+ * should be on screen. Render thread only.
+ *
+ * @return the number of frames that were skipped.
+ */
+int Decoder::SkipVideoFrames(double time)
+{
+	if (!isInitialized || FrontFrame(&videoFrames, &videoFramePool, &videoPackets, &videoTask) == NULL)
+	{
+		return 0;
+	}
+
+	int serial = videoPackets.GetSerial();
+	int skipped = 0;
+	QueuedFrame next;
+	while (videoFrames.Peek(1, &next) && next.serial == serial && GetVideoFrameTime(next.frame) <= time)
+	{
+		QueuedFrame queued;
+		videoFrames.Pop(&queued);
+		videoFramePool.Release(queued.frame);
+		skipped++;
+	}
+
+	//	One wakeup for the whole batch.
+	if (skipped > 0)
+	{
+		videoTask.Wake();
+	}
+
+	return skipped;
+}
+
+//	Decoded video frames waiting for the consumer, a snapshot.
+unsigned int Decoder::GetVideoFrameCount()
+{
+	return videoFrames.Size();
+}
+
+//	Lets the render thread release frames from before a seek while it isn't showing anything, so they can't fill up the buffer.
+void Decoder::DropStaleVideoFrames()
+{
+	if (!isInitialized)
+	{
+		return;
+	}
+
+	FrontFrame(&videoFrames, &videoFramePool, &videoPackets, &videoTask);
+}
+
+//	From now on the audio is decoded into the ring, instead of dropping packets when nobody plays them.
+void Decoder::SetAudioPulled()
+{
+	isAudioPulled = true;
+}
+
+//	Lets the audio thread skip the samples from before a seek while it plays silence, so they can't fill up the ring.
+void Decoder::DropStaleAudio()
+{
+	if (audioRing.DropDiscarded())
+	{
+		audioTask.Wake();
+	}
+}
+
+//	Turns the byte and time limits into frame counts for the streams that were opened.
+void Decoder::UpdateBufferLimits()
+{
+	if (videoCodecContext != NULL)
+	{
+		//	Queued frames are always yuv420p, whatever the codec outputs.
+		int frameBytes = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, videoCodecContext->width, videoCodecContext->height, 1);
+		AVRational frameRate = av_guess_frame_rate(inputContext, videoStream, NULL);
+		double fps = frameRate.num > 0 && frameRate.den > 0 ? av_q2d(frameRate) : 30.0;
+
+		double maxFrames = buffMaxSeconds * fps;
+		if (frameBytes > 0)
+		{
+			maxFrames = std::min(maxFrames, (double)(buffMaxBytes / frameBytes));
+		}
+
+		videoBuffMax = (unsigned int)std::max((double)MIN_VIDEO_FRAMES, std::min(maxFrames, (double)videoFrames.Capacity()));
+		LOG("Video buffer limit: %u frames of %d bytes. \n", videoBuffMax, frameBytes);
+	}
+
+	if (audioCodecContext != NULL)
+	{
+		//	Not every codec has a fixed frame size, assume a common one for those.
+		//	The decoder task waits until one resampled frame fits, with some slack for the delay of the resampler.
+		int samplesPerFrame = audioCodecContext->frame_size > 0 ? audioCodecContext->frame_size : 1024;
+		int inSampleRate = std::max(audioCodecContext->sample_rate, 1);
+		audioStepSamples = (unsigned int)((int64_t)samplesPerFrame * audioInfo.sampleRate / inSampleRate + 64) * audioInfo.channels;
+
+		double bytesPerSecond = (double)audioInfo.sampleRate * audioInfo.channels * sizeof(float);
+		double seconds = std::min(buffMaxSeconds, (double)buffMaxBytes / std::max(bytesPerSecond, 1.0));
+		unsigned int capacity = (unsigned int)(seconds * audioInfo.sampleRate) * audioInfo.channels;
+		audioRing.Init(std::max(capacity, (unsigned int)(MIN_AUDIO_FRAMES * audioStepSamples / MIN_PLAYBACK_SPEED)));
+		LOG("Audio buffer limit: %u samples. \n", audioRing.Capacity());
+	}
+}
+
+Decoder::BufferState Decoder::GetBufferState(FrameRing<QueuedFrame>* frameBuff, unsigned int buffMax)
+{
+	unsigned int size = frameBuff->Size();
+	if (size >= buffMax)
+	{
+		return BufferState::FULL;
+	}
+	else if (size == 0)
+	{
+		return BufferState::EMPTY;
+	}
+	else
+	{
+		return BufferState::NORMAL;
+	}
+}
+
+bool Decoder::IsBuffBlocked()
+{
+	if (videoInfo.isEnabled && videoPackets.IsFull())
+	{
+		return true;
+	}
+
+	if (audioInfo.isEnabled && audioPackets.IsFull())
+	{
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * One step of the video decoder task: hands the next packet to the codec and
+ * queues the frames that come out. Waits while there is no packet, or while
+ * the frame buffer is full and the codec won't take more input.
+ */
+Scheduler::StepResult Decoder::VideoDecodeStep()
+{
+	if (!isDecoding)
+	{
+		av_packet_unref(&videoPacket);
+		isVideoPacketPending = false;
+		return Scheduler::STEP_DONE;
+	}
+
+	//	Frames that didn't fit into the buffer during the last step are still in the codec.
+	if (!ReceiveVideoFrames(videoPacketSerial))
+	{
+		return Scheduler::STEP_WAIT;
+	}
+
+	if (!isVideoPacketPending)
+	{
+		int result = videoPackets.Get(&videoPacket, false, &videoPacketSerial);
+		if (result == PacketQueue::ABORTED)
+		{
+			return Scheduler::STEP_DONE;
+		}
+
+		if (result == PacketQueue::EMPTY)
+		{
+			return Scheduler::STEP_WAIT;
+		}
+		WakeDemux();
+
+		if (PacketQueue::IsFlushPacket(&videoPacket))
+		{
+			avcodec_flush_buffers(videoCodecContext);
+			SetSkipLevel(0);
+			lateFrames = onTimeFrames = consecutiveDrops = packetsInCodec = 0;
+			videoNextPts = AV_NOPTS_VALUE;
+
+			double target;
+			{
+				std::lock_guard<std::mutex> lock(seekMutex);
+				target = seekTarget;
+				seekTarget = -1;
+				videoSeekGeneration = seekGeneration;
+			}
+
+			if (target >= 0)
+			{
+				AVRational frameRate = av_guess_frame_rate(inputContext, videoStream, NULL);
+				videoSeekPts = av_rescale_q((int64_t)(target * AV_TIME_BASE), AV_TIME_BASE_Q, videoStream->time_base);
+				videoFrameDuration = frameRate.num > 0 && frameRate.den > 0 ? av_rescale_q(1, av_inv_q(frameRate), videoStream->time_base) : 0;
+			}
+
+			av_packet_unref(&videoPacket);
+			return Scheduler::STEP_AGAIN;
+		}
+
+		isVideoPacketPending = true;
+	}
+
+	if (skipLevel < GetMinSkipLevel())
+	{
+		SetSkipLevel(GetMinSkipLevel());
+	}
+
+	if (!UpdateVideoFrame(&videoPacket, videoPacketSerial))
+	{
+		return Scheduler::STEP_WAIT;
+	}
+
+	isVideoPacketPending = false;
+	av_packet_unref(&videoPacket);
+
+	return Scheduler::STEP_AGAIN;
+}
+
+/**
+ * One step of the audio decoder task, one packet at a time while there is
+ * room in the sample ring. Until the audio thread pulls for the first time,
+ * packets are only dropped when their queue is full, so they don't hold back
+ * the video of a player whose audio is never played.
+ */
+Scheduler::StepResult Decoder::AudioDecodeStep()
+{
+	if (!isDecoding)
+	{
+		return Scheduler::STEP_DONE;
+	}
+
+	if (audioRing.Space() < GetAudioStepSpace() || (!isAudioPulled && !audioPackets.IsFull()))
+	{
+		return Scheduler::STEP_WAIT;
+	}
+
+	AVPacket decodePacket;
+	av_init_packet(&decodePacket);
+	int serial = 0;
+
+	int result = audioPackets.Get(&decodePacket, false, &serial);
+	if (result == PacketQueue::ABORTED)
+	{
+		return Scheduler::STEP_DONE;
+	}
+
+	if (result == PacketQueue::EMPTY)
+	{
+		return Scheduler::STEP_WAIT;
+	}
+	WakeDemux();
+
+	if (PacketQueue::IsFlushPacket(&decodePacket))
+	{
+		//	Re-initializing the resampler drops the samples it still holds.
+		avcodec_flush_buffers(audioCodecContext);
+		swr_init(swrContext);
+		audioRing.Discard();
+		isAudioDrained = false;
+		audioDiffCum = 0;
+		audioDiffAvgCount = 0;
+		FreeAudioFilter();
+	}
+	else if (isAudioPulled)
+	{
+		UpdateAudioFrame(&decodePacket, serial);
+	}
+
+	av_packet_unref(&decodePacket);
+
+	return Scheduler::STEP_AGAIN;
+}
+
+/**
+ * This function is called for updating a video frame.
+ *
+ * The video task reads in packets from the video queue and sends them to
+ * the codec here. A packet can produce no frame at all (B-frame reordering,
+ * frame threading delay) or several, so every frame the codec has ready is
+ * received and queued. A null packet drains the codec at the end of the file.
+ *
+ * @return false if the codec didn't take the packet because the frame buffer is full, it has to be sent again.
+ */
+bool Decoder::UpdateVideoFrame(AVPacket* decodePacket, int serial)
+{
+	//	A newer seek already came in, don't spend any time on the old position.
+	if (serial != videoPackets.GetSerial())
+	{
+		return true;
+	}
+
+	//	Between the keyframe and the seek target only the frames that others reference have to be decoded.
+	if (videoSeekPts != AV_NOPTS_VALUE && decodePacket->data != NULL)
+	{
+		bool isBeforeTarget = decodePacket->pts != AV_NOPTS_VALUE && IsBeforeSeekTarget(decodePacket->pts, decodePacket->duration);
+		videoCodecContext->skip_frame = isBeforeTarget ? AVDISCARD_NONREF : SKIP_FRAME[skipLevel];
+		videoCodecContext->skip_loop_filter = isBeforeTarget ? AVDISCARD_NONREF : SKIP_LOOP_FILTER[skipLevel];
+	}
+
+	int errorCode = avcodec_send_packet(videoCodecContext, decodePacket);
+
+	//	The codec won't take more input until its output has been received, the packet is still ours to resend.
+	while (errorCode == AVERROR(EAGAIN) && isDecoding)
+	{
+		if (!ReceiveVideoFrames(serial))
+		{
+			return false;
+		}
+		errorCode = avcodec_send_packet(videoCodecContext, decodePacket);
+	}
+
+	if (errorCode < 0 && errorCode != AVERROR_EOF)
+	{
+		LOG("avcodec_send_packet error(%x). \n", errorCode);
+	}
+	else if (decodePacket->data != NULL)
+	{
+		packetsInCodec++;
+	}
+
+	//	Whatever doesn't fit into the buffer now is received at the next step.
+	ReceiveVideoFrames(serial);
+	return true;
+}
+
+/**
+ * Queues frames until the codec needs more input (EAGAIN) or is fully drained (EOF).
+ *
+ * @return false if it stopped because the frame buffer is full, the rest of the frames stay in the codec.
+ */
+bool Decoder::ReceiveVideoFrames(int serial)
+{
+	while (isDecoding)
+	{
+		if (videoFrames.Size() >= videoBuffMax)
+		{
+			return false;
+		}
+
+		AVFrame* frame = videoFramePool.Acquire();
+		int errorCode = avcodec_receive_frame(videoCodecContext, frame);
+		if (errorCode < 0)
+		{
+			if (errorCode != AVERROR(EAGAIN) && errorCode != AVERROR_EOF)
+			{
+				LOG("avcodec_receive_frame error(%x). \n", errorCode);
+			}
+
+			//	Drained at the end of the file, whatever did not come out was skipped.
+			if (errorCode == AVERROR_EOF && skipLevel > 0)
+			{
+				skippedFrames += packetsInCodec;
+				packetsInCodec = 0;
+			}
+
+			//	The target was past the last frame, there is nothing left to wait for.
+			if (errorCode == AVERROR_EOF && videoSeekPts != AV_NOPTS_VALUE)
+			{
+				FinishSeek();
+			}
+
+			videoFramePool.Recycle(frame);
+			return true;
+		}
+		packetsInCodec--;
+
+		if (serial != videoPackets.GetSerial())
+		{
+			videoFramePool.Recycle(frame);
+			continue;
+		}
+
+		SynchronizeVideo(frame);
+
+		bool isSeekTarget = false;
+		if (videoSeekPts != AV_NOPTS_VALUE)
+		{
+			if (frame->best_effort_timestamp != AV_NOPTS_VALUE && IsBeforeSeekTarget(frame->best_effort_timestamp, frame->pkt_duration))
+			{
+				videoFramePool.Recycle(frame);
+				continue;
+			}
+
+			isSeekTarget = true;
+		}
+
+		//	Drop it before it costs any more work. The seek target is always shown.
+		if (!isSeekTarget && IsFrameLate(frame))
+		{
+			droppedFrames++;
+			videoFramePool.Recycle(frame);
+			continue;
+		}
+
+		if (!ConvertVideoFrame(&frame))
+		{
+			videoFramePool.Recycle(frame);
+			continue;
+		}
+
+		PushFrame(&videoFrames, &videoFramePool, frame, serial, &videoPackets);
+
+		if (isSeekTarget)
+		{
+			FinishSeek();
+		}
+	}
+
+	return true;
+}
+
+void Decoder::UpdateAudioFrame(AVPacket* decodePacket, int serial)
+{
+	//	A newer seek already came in, don't spend any time on the old position.
+	if (serial != audioPackets.GetSerial())
+	{
+		return;
+	}
+
+	//	Audio frames are small and the ring always has room for one, so a single receive makes room for the packet.
+	int errorCode = avcodec_send_packet(audioCodecContext, decodePacket);
+	if (errorCode == AVERROR(EAGAIN))
+	{
+		ReceiveAudioFrames(serial);
+		errorCode = avcodec_send_packet(audioCodecContext, decodePacket);
+	}
+
+	if (errorCode < 0 && errorCode != AVERROR_EOF)
+	{
+		LOG("avcodec_send_packet error(%x). \n", errorCode);
+	}
+
+	ReceiveAudioFrames(serial);
+}
+
+/**
+ * Resamples frames into the ring until the codec needs more input (EAGAIN)
+ * or is fully drained (EOF). Every frame marks the pts of the samples that
+ * come after it, those give the audio thread its clock.
+ */
+void Decoder::ReceiveAudioFrames(int serial)
+{
+	while (isDecoding && audioRing.Space() >= GetAudioStepSpace())
+	{
+		int errorCode = avcodec_receive_frame(audioCodecContext, audioDecodeFrame);
+		if (errorCode < 0)
+		{
+			if (errorCode != AVERROR(EAGAIN) && errorCode != AVERROR_EOF)
+			{
+				LOG("avcodec_receive_frame error(%x). \n", errorCode);
+			}
+
+			//	The resampler still holds the last few samples of the stream.
+			if (errorCode == AVERROR_EOF && !isAudioDrained)
+			{
+				ResampleAudio(NULL, 0);
+				audioRing.MarkTime(audioWritePts, serial);
+				isAudioDrained = true;
+			}
+			return;
+		}
+
+		AVFrame* frame = audioDecodeFrame;
+		int sampleRate = frame->sample_rate > 0 ? frame->sample_rate : audioCodecContext->sample_rate;
+		if (frame->best_effort_timestamp != AV_NOPTS_VALUE)
+		{
+			audioWritePts = av_q2d(audioStream->time_base) * frame->best_effort_timestamp;
+		}
+
+		//	The compensation is spread over the wanted number of samples, in the output rate.
+		int wantedSamples = SynchronizeAudio(frame->nb_samples, sampleRate);
+		if (wantedSamples != frame->nb_samples)
+		{
+			int outputRate = audioInfo.sampleRate;
+			swr_set_compensation(swrContext, (int)((int64_t)(wantedSamples - frame->nb_samples) * outputRate / sampleRate), (int)((int64_t)wantedSamples * outputRate / sampleRate));
+		}
+
+		ResampleAudio((const uint8_t**)frame->extended_data, frame->nb_samples);
+		audioWritePts += (double)frame->nb_samples / sampleRate;
+		av_frame_unref(frame);
+
+		//	The resampler and the tempo filter hold a few samples back, the ones in the ring end that much earlier.
+		double delay = (swr_get_delay(swrContext, audioInfo.sampleRate) + audioFilterDelay) / audioInfo.sampleRate;
+		audioRing.MarkTime(audioWritePts - delay, serial);
+	}
+}
+
+/**
+ * How many samples the frame should have to bring the audio back to the
+ * master clock, like synchronize_audio in main.c. The difference is averaged
+ * over AUDIO_DIFF_AVG_NB frames first and only corrected once it is larger
+ * than about a device buffer, by at most SAMPLE_CORRECTION_PERCENT_MAX.
+ *
+ * @return sampleCount when the audio is the master or in sync.
+ */
+int Decoder::SynchronizeAudio(int sampleCount, int sampleRate)
+{
+	if (GetSyncMaster() == SYNC_AUDIO || audioInfo.sampleRate == 0 || audioInfo.channels == 0)
+	{
+		return sampleCount;
+	}
+
+	double audioTime = audioClock.Get(clockSerial, Clock::Now());
+	double masterTime = GetMasterClock();
+	if (audioTime < 0 || masterTime < 0)
+	{
+		return sampleCount;
+	}
+
+	//	Too far apart to correct, one of the clocks was just set. Start over with the average.
+	double diff = audioTime - masterTime;
+	if (fabs(diff) >= NOSYNC_THRESHOLD)
+	{
+		audioDiffCum = 0;
+		audioDiffAvgCount = 0;
+		return sampleCount;
+	}
+
+	audioDiffCum = diff + AUDIO_DIFF_AVG_COEF * audioDiffCum;
+	if (audioDiffAvgCount < AUDIO_DIFF_AVG_NB)
+	{
+		audioDiffAvgCount++;
+		return sampleCount;
+	}
+
+	double avgDiff = audioDiffCum * (1.0 - AUDIO_DIFF_AVG_COEF);
+	double threshold = (double)audioStepSamples / audioInfo.channels / audioInfo.sampleRate;
+	if (fabs(avgDiff) < threshold)
+	{
+		return sampleCount;
+	}
+
+	//	Audio that is ahead gets more samples, so it takes longer to play.
+	int wantedSamples = sampleCount + (int)(diff * sampleRate);
+	int minSamples = sampleCount * (100 - SAMPLE_CORRECTION_PERCENT_MAX) / 100;
+	int maxSamples = sampleCount * (100 + SAMPLE_CORRECTION_PERCENT_MAX) / 100;
+	return std::min(std::max(wantedSamples, minSamples), maxSamples);
+}
+
+//	Converts to interleaved floats in the output layout and stretches them to the playback speed. NULL input flushes both.
+void Decoder::ResampleAudio(const uint8_t** input, int sampleCount)
+{
+	int converted = 0;
+	int maxSamples = swr_get_out_samples(swrContext, sampleCount);
+	if (maxSamples > 0)
+	{
+		size_t scratchSize = (size_t)maxSamples * audioInfo.channels;
+		if (audioScratch.size() < scratchSize)
+		{
+			audioScratch.resize(scratchSize);
+			allocationCount++;
+		}
+
+		uint8_t* output = (uint8_t*)audioScratch.data();
+		converted = std::max(swr_convert(swrContext, &output, maxSamples, input, sampleCount), 0);
+	}
+
+	double speed = playbackSpeed;
+	if (speed != audioFilterSpeed)
+	{
+		BuildAudioFilter(speed);
+	}
+
+	if (audioFilterGraph != NULL)
+	{
+		StretchAudio(converted, input == NULL);
+	}
+	else if (converted > 0)
+	{
+		WriteAudio(audioScratch.data(), converted);
+	}
+}
+
+/**
+ * Sets up atempo filters for the speed, or none at normal speed. Samples
+ * still in the previous graph are dropped, that is a few milliseconds.
+ *
+ * @return false if the graph could not be created, the audio plays at normal speed then.
+ */
+bool Decoder::BuildAudioFilter(double speed)
+{
+	FreeAudioFilter();
+	audioFilterSpeed = speed;
+	if (speed == 1.0)
+	{
+		return true;
+	}
+
+	std::string filters;
+	double tempo = speed;
+	while (tempo > MAX_ATEMPO)
+	{
+		filters += "atempo=2.0,";
+		tempo /= MAX_ATEMPO;
+	}
+	while (tempo < MIN_ATEMPO)
+	{
+		filters += "atempo=0.5,";
+		tempo /= MIN_ATEMPO;
+	}
+	char lastFilter[32];
+	snprintf(lastFilter, sizeof(lastFilter), "atempo=%f", tempo);
+	filters += lastFilter;
+
+	char sourceArgs[256];
+	snprintf(sourceArgs, sizeof(sourceArgs), "sample_rate=%u:sample_fmt=%s:channel_layout=0x%llx:time_base=1/%u",
+			 audioInfo.sampleRate, av_get_sample_fmt_name(AV_SAMPLE_FMT_FLT),
+			 (unsigned long long)av_get_default_channel_layout(audioInfo.channels), audioInfo.sampleRate);
+
+	//	The graph runs on the audio task, it doesn't need threads of its own.
+	audioFilterGraph = avfilter_graph_alloc();
+	audioFilterGraph->nb_threads = 1;
+
+	int errorCode = avfilter_graph_create_filter(&audioFilterSource, avfilter_get_by_name("abuffer"), "in", sourceArgs, NULL, audioFilterGraph);
+	if (errorCode >= 0)
+	{
+		errorCode = avfilter_graph_create_filter(&audioFilterSink, avfilter_get_by_name("abuffersink"), "out", NULL, NULL, audioFilterGraph);
+	}
+	if (errorCode >= 0)
+	{
+		const AVSampleFormat sampleFormats[] = { AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_NONE };
+		errorCode = av_opt_set_int_list(audioFilterSink, "sample_fmts", sampleFormats, AV_SAMPLE_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
+	}
+
+	if (errorCode >= 0)
+	{
+		AVFilterInOut* outputs = avfilter_inout_alloc();
+		AVFilterInOut* inputs = avfilter_inout_alloc();
+		outputs->name = av_strdup("in");
+		outputs->filter_ctx = audioFilterSource;
+		outputs->pad_idx = 0;
+		outputs->next = NULL;
+		inputs->name = av_strdup("out");
+		inputs->filter_ctx = audioFilterSink;
+		inputs->pad_idx = 0;
+		inputs->next = NULL;
+
+		errorCode = avfilter_graph_parse_ptr(audioFilterGraph, filters.c_str(), &inputs, &outputs, NULL);
+		avfilter_inout_free(&inputs);
+		avfilter_inout_free(&outputs);
+	}
+
+	if (errorCode >= 0)
+	{
+		errorCode = avfilter_graph_config(audioFilterGraph, NULL);
+	}
+
+	if (errorCode < 0)
+	{
+		LOG("Audio filter \"%s\" error(%x). \n", filters.c_str(), errorCode);
+		FreeAudioFilter();
+		audioFilterSpeed = speed;
+		return false;
+	}
+
+	return true;
+}
+
+//	Back to normal speed without a graph, until the next frame builds one for the current speed.
+void Decoder::FreeAudioFilter()
+{
+	avfilter_graph_free(&audioFilterGraph);
+	audioFilterSource = NULL;
+	audioFilterSink = NULL;
+	audioFilterSpeed = 1.0;
+	audioFilterDelay = 0;
+}
+
+/**
+ * Runs the resampled samples in the scratch buffer through the tempo filters
+ * and writes whatever comes out to the ring. At the end of the stream the
+ * graph is flushed and freed.
+ */
+void Decoder::StretchAudio(int sampleCount, bool isFlush)
+{
+	int errorCode = 0;
+	if (sampleCount > 0)
+	{
+		//	The source copies the samples, so the frame can point straight at the scratch buffer.
+		AVFrame* frame = audioFilterInput;
+		frame->data[0] = (uint8_t*)audioScratch.data();
+		frame->extended_data = frame->data;
+		frame->linesize[0] = sampleCount * audioInfo.channels * sizeof(float);
+		frame->nb_samples = sampleCount;
+		frame->format = AV_SAMPLE_FMT_FLT;
+		frame->sample_rate = audioInfo.sampleRate;
+		frame->channels = audioInfo.channels;
+		frame->channel_layout = av_get_default_channel_layout(audioInfo.channels);
+		frame->pts = audioFilterSamples;
+		audioFilterSamples += sampleCount;
+
+		errorCode = av_buffersrc_write_frame(audioFilterSource, frame);
+		audioFilterDelay += sampleCount;
+	}
+
+	if (isFlush)
+	{
+		errorCode = av_buffersrc_write_frame(audioFilterSource, NULL);
+	}
+
+	if (errorCode < 0)
+	{
+		LOG("av_buffersrc_write_frame error(%x). \n", errorCode);
+	}
+
+	while (av_buffersink_get_frame(audioFilterSink, audioFilterOutput) >= 0)
+	{
+		WriteAudio((const float*)audioFilterOutput->data[0], audioFilterOutput->nb_samples);
+		audioFilterDelay = std::max(audioFilterDelay - audioFilterOutput->nb_samples * audioFilterSpeed, 0.0);
+		av_frame_unref(audioFilterOutput);
+	}
+
+	if (isFlush)
+	{
+		FreeAudioFilter();
+	}
+}
+
+void Decoder::WriteAudio(const float* samples, int sampleCount)
+{
+	unsigned int count = (unsigned int)sampleCount * audioInfo.channels;
+	if (audioRing.Write(samples, count) < count)
+	{
+		audioOverruns++;
+	}
+}
+
+//	Room one decoded frame needs in the ring. Slow playback stretches a frame to more samples.
+unsigned int Decoder::GetAudioStepSpace()
+{
+	double speed = playbackSpeed;
+	return speed < 1.0 ? (unsigned int)(audioStepSamples / speed) : audioStepSamples;
+}
+
+//	Presentation time of a decoded video frame in seconds.
+double Decoder::GetVideoFrameTime(AVFrame* frame)
+{
+	return av_q2d(videoStream->time_base) * frame->best_effort_timestamp;
+}
+
+/**
+ * Compares the frame with the presentation time and keeps track of how far
+ * behind the decoder is. Under sustained lag the codec is told to skip more
+ * and more work: first the non-reference frames, then all B-frames.
+ *
+ * @return true if the frame should be dropped.
+ */
+bool Decoder::IsFrameLate(AVFrame* frame)
+{
+	double now = GetMasterClock();
+	if (now < 0)
+	{
+		return false;
+	}
+
+	//	A video master shows every frame and slows down instead, like main.c.
+	AVRational frameRate = av_guess_frame_rate(inputContext, videoStream, frame);
+	double frameDuration = frameRate.num > 0 && frameRate.den > 0 ? av_q2d(av_inv_q(frameRate)) : 0;
+	double frameTime = GetVideoFrameTime(frame);
+	bool isLate = GetSyncMaster() != SYNC_VIDEO && frameTime + frameDuration < now;
+
+	if (isLate)
+	{
+		onTimeFrames = 0;
+		if (++lateFrames >= SKIP_ESCALATE_FRAMES && skipLevel < 2)
+		{
+			SetSkipLevel(skipLevel + 1);
+			lateFrames = 0;
+		}
+	}
+	else
+	{
+		lateFrames = 0;
+		if (++onTimeFrames >= SKIP_RECOVER_FRAMES && skipLevel > GetMinSkipLevel())
+		{
+			SetSkipLevel(skipLevel - 1);
+			onTimeFrames = 0;
+		}
+	}
+
+	if (!isLate || consecutiveDrops >= MAX_CONSECUTIVE_DROPS)
+	{
+		consecutiveDrops = 0;
+		return false;
+	}
+
+	consecutiveDrops++;
+	return true;
+}
+
+//	Frames without a timestamp continue from the one before, like synchronize_video in main.c. A repeated field stretches the duration by half a frame.
+void Decoder::SynchronizeVideo(AVFrame* frame)
+{
+	if (frame->best_effort_timestamp == AV_NOPTS_VALUE)
+	{
+		frame->best_effort_timestamp = videoNextPts;
+	}
+
+	if (frame->best_effort_timestamp == AV_NOPTS_VALUE)
+	{
+		return;
+	}
+
+	AVRational frameRate = av_guess_frame_rate(inputContext, videoStream, frame);
+	int64_t duration = frameRate.num > 0 && frameRate.den > 0 ? av_rescale_q(1, av_inv_q(frameRate), videoStream->time_base) : frame->pkt_duration;
+	videoNextPts = frame->best_effort_timestamp + duration + duration * frame->repeat_pict / 2;
+}
+
+/**
+ * Replaces a frame the render thread can't upload as it is with a yuv420p copy
+ * at the size of the video. Deeper formats are dithered down to 8 bit by swscale.
+ *
+ * @return false if the frame could not be converted, it is left alone then.
+ */
+bool Decoder::ConvertVideoFrame(AVFrame** frame)
+{
+	AVFrame* source = *frame;
+	if (source->format == AV_PIX_FMT_YUV420P && source->width == videoInfo.width && source->height == videoInfo.height)
+	{
+		return true;
+	}
+
+	double startTime = Clock::Now();
+
+	swsContext = sws_getCachedContext(swsContext, source->width, source->height, (AVPixelFormat)source->format,
+		videoInfo.width, videoInfo.height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+	if (swsContext == NULL)
+	{
+		LOG("Can't convert video frames from %s.\n", av_get_pix_fmt_name((AVPixelFormat)source->format));
+		return false;
+	}
+
+	AVFrame* output = videoFramePool.Acquire();
+	output->format = AV_PIX_FMT_YUV420P;
+	output->width = videoInfo.width;
+	output->height = videoInfo.height;
+
+	if (convertBufferPool.GetFrameBuffer(output) < 0 ||
+		sws_scale(swsContext, source->data, source->linesize, 0, source->height, output->data, output->linesize) <= 0)
+	{
+		videoFramePool.Recycle(output);
+		return false;
+	}
+
+	av_frame_copy_props(output, source);
+	videoFramePool.Recycle(source);
+	*frame = output;
+
+	double seconds = Clock::Now() - startTime;
+	convertedFrames++;
+	convertSeconds = convertSeconds + seconds;
+	lastConvertSeconds = seconds;
+	return true;
+}
+
+//	The skip level late frames can't go below, raised while playing fast.
+int Decoder::GetMinSkipLevel()
+{
+	return playbackSpeed > FAST_PLAYBACK_SPEED ? 1 : 0;
+}
+
+//	0 decodes everything, 1 skips non-reference frames, 2 skips all bidirectional frames.
+void Decoder::SetSkipLevel(int level)
+{
+	//	Packets that went in before the switch and never came out were discarded by the codec.
+	if (skipLevel > 0 && packetsInCodec > 0)
+	{
+		skippedFrames += packetsInCodec;
+	}
+	packetsInCodec = 0;
+
+	skipLevel = level;
+	videoCodecContext->skip_frame = SKIP_FRAME[level];
+	videoCodecContext->skip_loop_filter = SKIP_LOOP_FILTER[level];
+	LOG("Video skip level %d. \n", level);
+}
+
+//	A frame is before the target when it is already over at the target time.
+bool Decoder::IsBeforeSeekTarget(int64_t pts, int64_t duration)
+{
+	return pts + (duration > 0 ? duration : videoFrameDuration) <= videoSeekPts;
+}
+
+//	Back to normal decoding, and let the demux stage know the seek is done.
+void Decoder::FinishSeek()
+{
+	videoSeekPts = AV_NOPTS_VALUE;
+	videoCodecContext->skip_frame = SKIP_FRAME[skipLevel];
+	videoCodecContext->skip_loop_filter = SKIP_LOOP_FILTER[skipLevel];
+	packetsInCodec = 0;
+
+	CompleteSeek(videoSeekGeneration);
+}
+
+//	Generations only go up, a late completion of an older seek can't hide a newer one.
+void Decoder::CompleteSeek(int generation)
+{
+	int completed = completedSeekGeneration;
+	while (completed < generation && !completedSeekGeneration.compare_exchange_weak(completed, generation))
+	{
+	}
+
+	WakeDemux();
+}
+
+//	Only called from the decoder task that owns frameBuff.
+void Decoder::PushFrame(FrameRing<QueuedFrame>* frameBuff, FramePool* pool, AVFrame* frame, int serial, PacketQueue* packets)
+{
+	//	A seek happened while this packet was being decoded, the frame belongs to the old position.
+	QueuedFrame queued = { frame, serial };
+	if (serial != packets->GetSerial() || !frameBuff->Push(queued))
+	{
+		pool->Recycle(frame);
+	}
+}
+
+//	Only called from the consumer. Drops frames that were decoded before the last seek.
+//	Waking the producer is a single compare and swap unless it is waiting for buffer space.
+AVFrame* Decoder::FrontFrame(FrameRing<QueuedFrame>* frameBuff, FramePool* pool, PacketQueue* packets, Scheduler::Task* producer)
+{
+	QueuedFrame queued;
+	while (frameBuff->Front(&queued))
+	{
+		if (queued.serial == packets->GetSerial())
+		{
+			return queued.frame;
+		}
+
+		frameBuff->Pop(&queued);
+		pool->Release(queued.frame);
+		producer->Wake();
+	}
 
-	std::lock_guard<std::mutex> lock(audioMutex);
-	audioFrames.push(frame);
-	UpdateBufferState();
-	av_frame_free(&frameDecoded);
+	return NULL;
 }
 
-void Decoder::FreeFrontFrame(std::queue<AVFrame*>* frameBuff, std::mutex* mutex)
+void Decoder::FreeFrontFrame(FrameRing<QueuedFrame>* frameBuff, FramePool* pool, Scheduler::Task* producer)
 {
-	std::lock_guard<std::mutex> lock(*mutex);
-	if (!isInitialized || frameBuff->size() == 0)
+	QueuedFrame queued;
+	if (!isInitialized || !frameBuff->Pop(&queued))
 	{
 		return;
 	}
 
-	AVFrame* frame = frameBuff->front();
-	av_frame_free(&frame);
-	frameBuff->pop();
-	UpdateBufferState();
+	pool->Release(queued.frame);
+	producer->Wake();
 }
 
-//	frameBuff.clear would only clean the pointer rather than whole resources. So we need to clear frameBuff by ourself.
-void Decoder::FlushBuffer(std::queue<AVFrame*>* frameBuff, std::mutex* mutex)
+//	Only safe while the decoder tasks are stopped.
+void Decoder::FlushBuffer(FrameRing<QueuedFrame>* frameBuff)
 {
-	std::lock_guard<std::mutex> lock(*mutex);
-	while (!frameBuff->empty())
+	QueuedFrame queued;
+	while (frameBuff->Pop(&queued))
 	{
-		av_frame_free(&(frameBuff->front()));
-		frameBuff->pop();
+		av_frame_free(&queued.frame);
 	}
 }
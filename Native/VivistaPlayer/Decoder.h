@@ -1,10 +1,22 @@
 #pragma once
-#include <queue>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+#include "PacketQueue.h"
+#include "FrameRing.h"
+#include "FramePool.h"
+#include "AudioRing.h"
+#include "Clock.h"
+#include "KeyframeIndex.h"
+#include "Scheduler.h"
 
 extern "C" {
 #include <libavformat/avformat.h>
 #include <libswresample/swresample.h>
+#include <libavfilter/avfilter.h>
+#include <libswscale/swscale.h>
 }
 
 class Decoder
@@ -15,6 +27,23 @@ public:
 
 	enum BufferState { EMPTY, NORMAL, FULL };
 
+	enum DemuxResult { DEMUX_PACKET, DEMUX_BLOCKED, DEMUX_END };
+
+	//	The clock the other streams follow, like av_sync_type in main.c.
+	enum SyncMaster { SYNC_AUDIO, SYNC_VIDEO, SYNC_EXTERNAL };
+
+	//	Values match FFmpeg's FF_THREAD_* flags, DEFAULT lets the codec use whatever it supports.
+	enum ThreadType { THREAD_DEFAULT = 0, THREAD_FRAME = 1, THREAD_SLICE = 2 };
+
+	struct ThreadingConfig
+	{
+		int				videoThreadType;
+		int				videoThreadCount;	//	0 sizes the codec's thread pool to the number of cores
+		int				audioThreadCount;	//	0 keeps the codec default
+		uint64_t		videoAffinity;		//	CPU masks for the codec's own threads, 0 leaves them unpinned
+		uint64_t		audioAffinity;
+	};
+
 	struct VideoInfo
 	{
 		bool			isEnabled;
@@ -35,24 +64,52 @@ public:
 		BufferState		bufferState;
 	};
 
+	void SetThreadingConfig(ThreadingConfig config);
+	void SetFastOpen(bool isEnabled);
+	void SetAudioOutput(int sampleRate, bool isAllChannels);
+	ThreadingConfig GetThreadingConfig();
 	bool Init(const char* filePath);
-	bool Decode();
-	void Seek(double time);
+	void SetBufferLimits(int64_t maxBytes, double maxSeconds);
+	void Start();
+	void Stop();
+	int Demux();
+	void SetDemuxTask(Scheduler::Task* task);
+	void SetPriority(Scheduler::Priority priority);
+	void Seek(double time, int generation);
+	int GetSeekGeneration();
+	void WakeDemux();
+	void SetSyncMaster(SyncMaster master);
+	SyncMaster GetSyncMaster();
+	double GetMasterClock();
+	void SetPlaybackSpeed(double speed);
+	void SetLoop(bool isEnabled, double startTime);
+	double GetThreadCpuTime();
+	void GetTaskCpuTimes(double& videoSeconds, double& audioSeconds);
+	uint64_t GetAllocationCount();
+	int GetDroppedFrames();
+	int GetSkippedFrames();
+	void GetConvertStats(int& convertedFrames, double& totalSeconds, double& lastSeconds);
 
 	void StreamComponentOpen();
 	VideoInfo GetVideoInfo();
 	AudioInfo GetAudioInfo();
-	double	GetVideoFrame(unsigned char** outputY, unsigned char** outputU, unsigned char** outputV);
-	double	GetAudioFrame(unsigned char** outputFrame, int& frameSize);
+	double	GetVideoFrame(unsigned char** outputY, unsigned char** outputU, unsigned char** outputV, int* outputLinesize);
+	unsigned int GetAudioSamples(float* samples, unsigned int frameCount, unsigned int channels);
+	void GetAudioStats(int& underruns, int& overruns);
 	void EnableVideo(bool isEnabled);
 	void EnableAudio(bool isEnabled);
 	void FreeVideoFrame();
-	void FreeAudioFrame();
+	int SkipVideoFrames(double time);
+	unsigned int GetVideoFrameCount();
+	void DropStaleVideoFrames();
+	void DropStaleAudio();
+	void SetAudioPulled();
 
 private:
 	bool					isInitialized;
 	bool					isAudioAllChEnabled;
 	bool					useTCP;
+	bool					isFastOpen;
 
 	AVFormatContext*		inputContext;
 	int						videoStreamIndex;
@@ -65,26 +122,156 @@ private:
 	AVCodecContext*			audioCodecContext;
 
 	AVPacket				packet;
-	std::queue<AVFrame*>	videoFrames;
-	std::queue<AVFrame*>	audioFrames;
+	PacketQueue				videoPackets;
+	PacketQueue				audioPackets;
+
+	//	Frames are queued with the serial of their seek, so frames from older seeks never reach the render thread.
+	struct QueuedFrame
+	{
+		AVFrame*	frame;
+		int			serial;
+	};
+	FrameRing<QueuedFrame>	videoFrames;
+
+	std::atomic<uint64_t>	allocationCount;
+	FramePool				videoFramePool;
+	VideoBufferPool			videoBufferPool;
+	AVFrame*				audioDecodeFrame;
 	unsigned int			videoBuffMax;
-	unsigned int			audioBuffMax;
+	int64_t					buffMaxBytes;
+	double					buffMaxSeconds;
 
 	SwrContext*				swrContext;
+	int						audioOutputRate;
+
+	//	Resampled audio waits here for the audio thread. The scratch buffer only grows when a bigger frame comes along.
+	AudioRing				audioRing;
+	std::vector<float>		audioScratch;
+	unsigned int			audioStepSamples;
+	std::atomic<bool>		isAudioPulled;
+	std::atomic<bool>		isAudioDrained;
+	std::atomic<int>		audioUnderruns;
+	std::atomic<int>		audioOverruns;
+
+	//	Time-stretches the resampled audio to the playback speed, so the pitch stays the same. Audio task only.
+	//	There is no graph at normal speed. The delay counts samples that went in and didn't come out yet.
+	AVFilterGraph*			audioFilterGraph;
+	AVFilterContext*		audioFilterSource;
+	AVFilterContext*		audioFilterSink;
+	AVFrame*				audioFilterInput;
+	AVFrame*				audioFilterOutput;
+	double					audioFilterSpeed;
+	double					audioFilterDelay;
+	int64_t					audioFilterSamples;
 
 	VideoInfo				videoInfo;
 	AudioInfo				audioInfo;
+	ThreadingConfig			threadingConfig;
+
+	//	Woken by the decoder tasks when they take a packet out.
+	Scheduler::Task*		demuxTask;
+
+	//	Presentation clocks. A seek bumps clockSerial, which invalidates all of them until they are set again.
+	std::atomic<int>		syncMaster;
+	std::atomic<int>		clockSerial;
+	std::atomic<double>		playbackSpeed;
+	Clock					audioClock;
+	Clock					videoClock;
+	Clock					externalClock;
+
+	//	Audio task only. The averaged difference between the audio and the master clock, and the pts the next frame continues from.
+	double					audioDiffCum;
+	int						audioDiffAvgCount;
+	double					audioWritePts;
+
+	//	Video task only. The pts a frame without a timestamp gets.
+	int64_t					videoNextPts;
+
+	//	The render thread only uploads 8 bit yuv420p at the size of the video. The video task converts everything else,
+	//	e.g. 10 bit, 4:2:2 or NV12 output or a frame after a resolution change, into frames from its own buffer pool.
+	SwsContext*				swsContext;
+	VideoBufferPool			convertBufferPool;
+	std::atomic<int>		convertedFrames;
+	std::atomic<double>		convertSeconds;
+	std::atomic<double>		lastConvertSeconds;
+
+	//	Late frame handling, the counters are only touched by the video task.
+	std::atomic<int>		droppedFrames;
+	std::atomic<int>		skippedFrames;
+	int						skipLevel;
+	int						lateFrames;
+	int						onTimeFrames;
+	int						consecutiveDrops;
+	int						packetsInCodec;
+
+	//	Set by the demux stage, picked up by the video task together with the flush packet.
+	std::mutex				seekMutex;
+	double					seekTarget;
+	int						seekGeneration;
+	std::atomic<int>		completedSeekGeneration;
+	int						videoSeekGeneration;
+	int64_t					videoSeekPts;
+	int64_t					videoFrameDuration;
+
+	//	When looping, the timestamps of every iteration are moved past the end of the one before, so the clocks keep
+	//	running forward. Times are in AV_TIME_BASE, and apart from the two settings only the demux stage touches them.
+	std::atomic<bool>		isLooping;
+	std::atomic<double>		loopStartTime;
+	int64_t					loopOffset;
+	int64_t					loopIterationEnd;
+	int64_t					loopNextStart;
+	bool					isLoopStartPending;
+
+	KeyframeIndex			keyframeIndex;
+	std::thread				indexThread;
+	std::atomic<bool>		isIndexAborted;
+
+	//	A packet the video codec didn't take yet because its output didn't fit into the frame buffer.
+	AVPacket				videoPacket;
+	int						videoPacketSerial;
+	bool					isVideoPacketPending;
 
-	std::mutex				videoMutex;
-	std::mutex				audioMutex;
+	std::atomic<bool>		isDecoding;
+	Scheduler::Task			videoTask;
+	Scheduler::Task			audioTask;
 
-	void UpdateBufferState();
+	BufferState GetBufferState(FrameRing<QueuedFrame>* frameBuff, unsigned int buffMax);
+	void UpdateBufferLimits();
 
 	bool IsBuffBlocked();
-	void UpdateVideoFrame();
-	void UpdateAudioFrame();
-	void FreeFrontFrame(std::queue<AVFrame*>* frameBuff, std::mutex* mutex);
-	void FlushBuffer(std::queue<AVFrame*>* frameBuff, std::mutex* mutex);
+	Scheduler::StepResult VideoDecodeStep();
+	Scheduler::StepResult AudioDecodeStep();
+	bool UpdateVideoFrame(AVPacket* decodePacket, int serial);
+	bool ReceiveVideoFrames(int serial);
+	double GetVideoFrameTime(AVFrame* frame);
+	bool IsFrameLate(AVFrame* frame);
+	void SynchronizeVideo(AVFrame* frame);
+	bool ConvertVideoFrame(AVFrame** frame);
+	void UpdateVideoClock(double pts, int serial);
+	void SetSkipLevel(int level);
+	int GetMinSkipLevel();
+	bool IsBeforeSeekTarget(int64_t pts, int64_t duration);
+	void FinishSeek();
+	bool SeekToKeyframe(int64_t timeStamp);
+	bool LoopInput();
+	void OffsetLoopPacket(AVPacket* packet);
+	void ResetLoop();
+	void CompleteSeek(int generation);
+	void UpdateAudioFrame(AVPacket* decodePacket, int serial);
+	void ReceiveAudioFrames(int serial);
+	void ResampleAudio(const uint8_t** input, int sampleCount);
+	bool BuildAudioFilter(double speed);
+	void FreeAudioFilter();
+	void StretchAudio(int sampleCount, bool isFlush);
+	void WriteAudio(const float* samples, int sampleCount);
+	unsigned int GetAudioStepSpace();
+	int SynchronizeAudio(int sampleCount, int sampleRate);
+	void UpdateAudioClock(unsigned int delivered, unsigned int frameCount, int serial);
+	void SyncExternalClock(double pts, int serial, double time);
+	void PushFrame(FrameRing<QueuedFrame>* frameBuff, FramePool* pool, AVFrame* frame, int serial, PacketQueue* packets);
+	AVFrame* FrontFrame(FrameRing<QueuedFrame>* frameBuff, FramePool* pool, PacketQueue* packets, Scheduler::Task* producer);
+	void FreeFrontFrame(FrameRing<QueuedFrame>* frameBuff, FramePool* pool, Scheduler::Task* producer);
+	void FlushBuffer(FrameRing<QueuedFrame>* frameBuff);
 };
 
 
@@ -0,0 +1,143 @@
+#include "FileCache.h"
+#include "PlatformBase.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+static const char CACHE_MAGIC[4] = { 'V', 'V', 'C', 'F' };
+
+struct CacheHeader
+{
+	char		magic[4];
+	uint32_t	version;
+	int64_t		fileSize;
+	int64_t		modifiedTime;
+	uint64_t	dataSize;
+};
+
+std::mutex FileCache::directoryMutex;
+std::string FileCache::directory;
+
+//	An empty directory puts the cache files next to the videos again.
+void FileCache::SetDirectory(const char* directory)
+{
+	std::lock_guard<std::mutex> lock(directoryMutex);
+	FileCache::directory = directory != NULL ? directory : "";
+}
+
+/**
+ * Reads the cache entry of a video.
+ *
+ * @param   name     kind of entry, used as file extension
+ * @param   version  format version of the data, entries of other versions are ignored
+ *
+ * @return  false if there is no entry, or it was made for another version of the video.
+ */
+bool FileCache::Load(const char* videoPath, const char* name, uint32_t version, std::vector<uint8_t>* data)
+{
+	int64_t fileSize, modifiedTime;
+	if (!GetFileStamp(videoPath, &fileSize, &modifiedTime))
+	{
+		return false;
+	}
+
+	FILE* file = fopen(GetCachePath(videoPath, name).c_str(), "rb");
+	if (file == NULL)
+	{
+		return false;
+	}
+
+	CacheHeader header;
+	bool isValid = fread(&header, sizeof(header), 1, file) == 1
+		&& memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0
+		&& header.version == version
+		&& header.fileSize == fileSize
+		&& header.modifiedTime == modifiedTime;
+
+	if (isValid)
+	{
+		data->resize((size_t)header.dataSize);
+		isValid = header.dataSize == 0 || fread(data->data(), (size_t)header.dataSize, 1, file) == 1;
+	}
+
+	fclose(file);
+	return isValid;
+}
+
+//	Failing to write is not an error, the entry is simply made again next time.
+bool FileCache::Save(const char* videoPath, const char* name, uint32_t version, const std::vector<uint8_t>& data)
+{
+	CacheHeader header;
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = version;
+	header.dataSize = data.size();
+	if (!GetFileStamp(videoPath, &header.fileSize, &header.modifiedTime))
+	{
+		return false;
+	}
+
+	//	Write to a temporary file first, so a player that opens the same video never reads half an entry.
+	std::string path = GetCachePath(videoPath, name);
+	std::string tempPath = path + ".tmp";
+	FILE* file = fopen(tempPath.c_str(), "wb");
+	if (file == NULL)
+	{
+		return false;
+	}
+
+	bool isWritten = fwrite(&header, sizeof(header), 1, file) == 1
+		&& (data.empty() || fwrite(data.data(), data.size(), 1, file) == 1);
+	isWritten = fclose(file) == 0 && isWritten;
+
+	//	rename() doesn't replace existing files on Windows.
+	remove(path.c_str());
+	if (!isWritten || rename(tempPath.c_str(), path.c_str()) != 0)
+	{
+		remove(tempPath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+std::string FileCache::GetCachePath(const char* videoPath, const char* name)
+{
+	std::lock_guard<std::mutex> lock(directoryMutex);
+	if (directory.empty())
+	{
+		return std::string(videoPath) + "." + name;
+	}
+
+	//	Videos from different folders can have the same name, so name the entry after a hash of the full path (FNV-1a).
+	uint64_t hash = 14695981039346656037ULL;
+	for (const char* c = videoPath; *c != '\0'; c++)
+	{
+		hash = (hash ^ (uint8_t)*c) * 1099511628211ULL;
+	}
+
+	char fileName[32];
+	snprintf(fileName, sizeof(fileName), "%016llx", (unsigned long long)hash);
+	return directory + "/" + fileName + "." + name;
+}
+
+bool FileCache::GetFileStamp(const char* path, int64_t* size, int64_t* modifiedTime)
+{
+#if UNITY_WIN
+	struct _stat64 info;
+	if (_stat64(path, &info) != 0)
+	{
+		return false;
+	}
+#else
+	struct stat info;
+	if (stat(path, &info) != 0)
+	{
+		return false;
+	}
+#endif
+
+	*size = (int64_t)info.st_size;
+	*modifiedTime = (int64_t)info.st_mtime;
+	return true;
+}
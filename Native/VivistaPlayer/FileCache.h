@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <stdint.h>
+
+/**
+ * Small cache files that belong to a video, like its keyframe index.
+ *
+ * An entry is only valid for the exact file it was made for: the size and
+ * modification time of the video are stored with it and checked on load.
+ * Entries are kept in the directory given to SetDirectory(), or next to the
+ * video when no directory was set.
+ */
+class FileCache
+{
+public:
+	static void SetDirectory(const char* directory);
+
+	static bool Load(const char* videoPath, const char* name, uint32_t version, std::vector<uint8_t>* data);
+	static bool Save(const char* videoPath, const char* name, uint32_t version, const std::vector<uint8_t>& data);
+
+private:
+	static std::mutex		directoryMutex;
+	static std::string		directory;
+
+	static std::string GetCachePath(const char* videoPath, const char* name);
+	static bool GetFileStamp(const char* path, int64_t* size, int64_t* modifiedTime);
+};
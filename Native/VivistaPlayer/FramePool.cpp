@@ -0,0 +1,243 @@
+#include "FramePool.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+// Extra bytes at the end of every plane, same as the default get_buffer2 so SIMD code can overread.
+static const int PLANE_PADDING = 16 + 64 - 1;
+
+FramePool::FramePool(unsigned int capacity, std::atomic<uint64_t>* allocationCount)
+	: returned(capacity)
+{
+	this->allocationCount = allocationCount;
+}
+
+FramePool::~FramePool()
+{
+	AVFrame* frame;
+	while (returned.Pop(&frame))
+	{
+		av_frame_free(&frame);
+	}
+
+	for (size_t i = 0; i < spare.size(); i++)
+	{
+		av_frame_free(&spare[i]);
+	}
+	spare.clear();
+}
+
+AVFrame* FramePool::Acquire()
+{
+	AVFrame* frame;
+	while (returned.Pop(&frame))
+	{
+		av_frame_unref(frame);
+		spare.push_back(frame);
+	}
+
+	if (!spare.empty())
+	{
+		frame = spare.back();
+		spare.pop_back();
+		return frame;
+	}
+
+	(*allocationCount)++;
+	return av_frame_alloc();
+}
+
+void FramePool::Recycle(AVFrame* frame)
+{
+	av_frame_unref(frame);
+	spare.push_back(frame);
+}
+
+//	The ring is as big as the frame buffer, so it only overflows if frames were never acquired through this pool.
+void FramePool::Release(AVFrame* frame)
+{
+	if (!returned.Push(frame))
+	{
+		av_frame_free(&frame);
+	}
+}
+
+VideoBufferPool::VideoBufferPool(std::atomic<uint64_t>* allocationCount)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		pools[i] = NULL;
+		linesize[i] = 0;
+		planeSize[i] = 0;
+	}
+
+	format = AV_PIX_FMT_NONE;
+	width = 0;
+	height = 0;
+	this->allocationCount = allocationCount;
+}
+
+VideoBufferPool::~VideoBufferPool()
+{
+	ReleasePools();
+}
+
+//	Only codecs that support direct rendering can use our buffers, the others keep the default allocator.
+void VideoBufferPool::Attach(AVCodecContext* context)
+{
+	if (!(context->codec->capabilities & AV_CODEC_CAP_DR1))
+	{
+		return;
+	}
+
+	context->opaque = this;
+	context->get_buffer2 = GetBufferCallback;
+	context->thread_safe_callbacks = 1;
+}
+
+int VideoBufferPool::GetBuffer(AVCodecContext* context, AVFrame* frame, int flags)
+{
+	const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)frame->format);
+	if (desc == NULL || (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL)))
+	{
+		return avcodec_default_get_buffer2(context, frame, flags);
+	}
+
+	return GetPoolBuffer(context, frame);
+}
+
+//	The format, width and height of the frame have to be set.
+int VideoBufferPool::GetFrameBuffer(AVFrame* frame)
+{
+	return GetPoolBuffer(NULL, frame);
+}
+
+int VideoBufferPool::GetPoolBuffer(AVCodecContext* context, AVFrame* frame)
+{
+	//	Frame threading calls this from the codec's worker threads.
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (frame->format != format || frame->width != width || frame->height != height)
+	{
+		if (!Reinit(context, frame))
+		{
+			return AVERROR(ENOMEM);
+		}
+	}
+
+	for (int i = 0; i < 4 && pools[i] != NULL; i++)
+	{
+		frame->buf[i] = av_buffer_pool_get(pools[i]);
+		if (frame->buf[i] == NULL)
+		{
+			av_frame_unref(frame);
+			return AVERROR(ENOMEM);
+		}
+
+		frame->data[i] = frame->buf[i]->data;
+		frame->linesize[i] = linesize[i];
+	}
+	frame->extended_data = frame->data;
+
+	return 0;
+}
+
+//	Same plane layout as avcodec_default_get_buffer2, so every codec that accepts those buffers accepts ours.
+//	Without a codec the rows are only aligned for SIMD loads.
+bool VideoBufferPool::Reinit(AVCodecContext* context, AVFrame* frame)
+{
+	ReleasePools();
+
+	int alignedWidth = frame->width;
+	int alignedHeight = frame->height;
+	int linesizeAlign[AV_NUM_DATA_POINTERS];
+	if (context != NULL)
+	{
+		avcodec_align_dimensions2(context, &alignedWidth, &alignedHeight, linesizeAlign);
+	}
+	else
+	{
+		for (int i = 0; i < AV_NUM_DATA_POINTERS; i++)
+		{
+			linesizeAlign[i] = 32;
+		}
+	}
+
+	int unaligned;
+	do
+	{
+		if (av_image_fill_linesizes(linesize, (AVPixelFormat)frame->format, alignedWidth) < 0)
+		{
+			return false;
+		}
+
+		//	Increase the alignment of the width for the next try, if we need one.
+		alignedWidth += alignedWidth & ~(alignedWidth - 1);
+
+		unaligned = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			unaligned |= linesize[i] % linesizeAlign[i];
+		}
+	} while (unaligned);
+
+	uint8_t* data[4];
+	int totalSize = av_image_fill_pointers(data, (AVPixelFormat)frame->format, alignedHeight, NULL, linesize);
+	if (totalSize < 0)
+	{
+		return false;
+	}
+
+	//	data[] only holds offsets here, the first plane starts at NULL.
+	int lastPlane;
+	for (lastPlane = 0; lastPlane < 3 && data[lastPlane + 1] != NULL; lastPlane++)
+	{
+		planeSize[lastPlane] = (int)(data[lastPlane + 1] - data[lastPlane]);
+	}
+	planeSize[lastPlane] = totalSize - (int)(data[lastPlane] - data[0]);
+
+	for (int i = 0; i <= lastPlane; i++)
+	{
+		pools[i] = av_buffer_pool_init2(planeSize[i] + PLANE_PADDING, allocationCount, Allocate, NULL);
+		if (pools[i] == NULL)
+		{
+			ReleasePools();
+			return false;
+		}
+	}
+
+	format = frame->format;
+	width = frame->width;
+	height = frame->height;
+
+	return true;
+}
+
+//	Buffers that are still in use keep their pool alive until they are returned.
+void VideoBufferPool::ReleasePools()
+{
+	for (int i = 0; i < 4; i++)
+	{
+		av_buffer_pool_uninit(&pools[i]);
+		planeSize[i] = 0;
+	}
+
+	format = AV_PIX_FMT_NONE;
+	width = 0;
+	height = 0;
+}
+
+int VideoBufferPool::GetBufferCallback(AVCodecContext* context, AVFrame* frame, int flags)
+{
+	VideoBufferPool* pool = (VideoBufferPool*)context->opaque;
+	return pool->GetBuffer(context, frame, flags);
+}
+
+AVBufferRef* VideoBufferPool::Allocate(void* opaque, int size)
+{
+	std::atomic<uint64_t>* allocationCount = (std::atomic<uint64_t>*)opaque;
+	(*allocationCount)++;
+	return av_buffer_alloc(size);
+}
\ No newline at end of file
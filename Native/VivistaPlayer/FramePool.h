@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+#include "FrameRing.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+}
+
+/**
+ * Recycles AVFrames between a decoder task and the consumer of its frames.
+ *
+ * Acquire() and Recycle() may only be called from the decoder task,
+ * Release() only from the consumer. Released frames are unreferenced on the
+ * decoder task, so the consumer never ends up freeing picture buffers.
+ */
+class FramePool
+{
+public:
+	FramePool(unsigned int capacity, std::atomic<uint64_t>* allocationCount);
+	~FramePool();
+
+	AVFrame* Acquire();
+	void Recycle(AVFrame* frame);
+	void Release(AVFrame* frame);
+
+private:
+	FrameRing<AVFrame*>			returned;
+	std::vector<AVFrame*>		spare;
+	std::atomic<uint64_t>*		allocationCount;
+};
+
+/**
+ * Backs the get_buffer2 callback of a video codec context with one
+ * AVBufferPool per plane, sized for the current resolution and pixel format.
+ * The pools are rebuilt whenever the decoder output changes. Without a codec
+ * context, GetFrameBuffer() fills frames the same way, e.g. for the output
+ * of a conversion.
+ */
+class VideoBufferPool
+{
+public:
+	VideoBufferPool(std::atomic<uint64_t>* allocationCount);
+	~VideoBufferPool();
+
+	void Attach(AVCodecContext* context);
+	int GetFrameBuffer(AVFrame* frame);
+
+private:
+	std::mutex					mutex;
+	AVBufferPool*				pools[4];
+	int							format;
+	int							width;
+	int							height;
+	int							linesize[4];
+	int							planeSize[4];
+	std::atomic<uint64_t>*		allocationCount;
+
+	int GetBuffer(AVCodecContext* context, AVFrame* frame, int flags);
+	int GetPoolBuffer(AVCodecContext* context, AVFrame* frame);
+	bool Reinit(AVCodecContext* context, AVFrame* frame);
+	void ReleasePools();
+
+	static int GetBufferCallback(AVCodecContext* context, AVFrame* frame, int flags);
+	static AVBufferRef* Allocate(void* opaque, int size);
+};
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <vector>
+
+/**
+ * Fixed-capacity single-producer/single-consumer ring buffer.
+ *
+ * Push() may only be called from the producer thread, Front() and Pop() only
+ * from the consumer thread. Neither side ever takes a lock, so the render
+ * thread can not be blocked by a decoder thread.
+ */
+template<typename T>
+class FrameRing
+{
+public:
+	// The capacity is rounded up to a power of two.
+	explicit FrameRing(unsigned int capacity)
+	{
+		unsigned int size = 1;
+		while (size < capacity)
+		{
+			size <<= 1;
+		}
+
+		items.resize(size);
+		mask = size - 1;
+		head = 0;
+		tail = 0;
+	}
+
+	bool Push(const T& item)
+	{
+		unsigned int writeIndex = tail.load(std::memory_order_relaxed);
+		if (writeIndex - head.load(std::memory_order_acquire) > mask)
+		{
+			return false;
+		}
+
+		items[writeIndex & mask] = item;
+		tail.store(writeIndex + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool Front(T* item)
+	{
+		unsigned int readIndex = head.load(std::memory_order_relaxed);
+		if (readIndex == tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		*item = items[readIndex & mask];
+		return true;
+	}
+
+	// Looks at the item offset places behind the front, without removing anything.
+	bool Peek(unsigned int offset, T* item)
+	{
+		unsigned int readIndex = head.load(std::memory_order_relaxed);
+		if (tail.load(std::memory_order_acquire) - readIndex <= offset)
+		{
+			return false;
+		}
+
+		*item = items[(readIndex + offset) & mask];
+		return true;
+	}
+
+	bool Pop(T* item)
+	{
+		unsigned int readIndex = head.load(std::memory_order_relaxed);
+		if (readIndex == tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		*item = items[readIndex & mask];
+		head.store(readIndex + 1, std::memory_order_release);
+		return true;
+	}
+
+	// A snapshot, the other side may push or pop at any moment.
+	unsigned int Size()
+	{
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+	unsigned int Capacity()
+	{
+		return mask + 1;
+	}
+
+private:
+	std::vector<T>				items;
+	unsigned int				mask;
+
+	// Keep the indices on separate cache lines so the two threads don't keep stealing them from each other.
+	alignas(64) std::atomic<unsigned int>	head;
+	alignas(64) std::atomic<unsigned int>	tail;
+};
\ No newline at end of file
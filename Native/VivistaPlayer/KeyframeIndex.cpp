@@ -0,0 +1,131 @@
+#include "KeyframeIndex.h"
+#include "FileCache.h"
+#include "Logger.h"
+#include <algorithm>
+#include <string.h>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+static const char* CACHE_NAME = "keyframes";
+static const uint32_t CACHE_VERSION = 1;
+
+KeyframeIndex::KeyframeIndex()
+{
+	isReady = false;
+}
+
+//	Reads the index from the cache, if it was built for this exact file before.
+bool KeyframeIndex::Load(const char* filePath, int streamIndex)
+{
+	std::vector<uint8_t> data;
+	if (!FileCache::Load(filePath, CACHE_NAME, CACHE_VERSION, &data) || data.size() < sizeof(int32_t))
+	{
+		return false;
+	}
+
+	int32_t cachedStreamIndex;
+	memcpy(&cachedStreamIndex, data.data(), sizeof(int32_t));
+	size_t count = (data.size() - sizeof(int32_t)) / sizeof(Keyframe);
+	if (cachedStreamIndex != streamIndex || count == 0)
+	{
+		return false;
+	}
+
+	keyframes.resize(count);
+	memcpy(keyframes.data(), data.data() + sizeof(int32_t), count * sizeof(Keyframe));
+	isReady = true;
+
+	LOG("Loaded %d keyframes from the cache. \n", (int)count);
+	return true;
+}
+
+/**
+ * Reads through the whole file with a demuxer of its own, without decoding
+ * anything, and stores the index in the cache when done.
+ *
+ * @param   isAborted  checked after every packet, an aborted scan leaves the index empty
+ */
+bool KeyframeIndex::Build(const char* filePath, int streamIndex, const std::atomic<bool>* isAborted)
+{
+	AVFormatContext* formatContext = NULL;
+	if (avformat_open_input(&formatContext, filePath, NULL, NULL) < 0)
+	{
+		return false;
+	}
+
+	std::vector<Keyframe> found;
+	AVPacket packet;
+	av_init_packet(&packet);
+	packet.data = NULL;
+	packet.size = 0;
+
+	while (!*isAborted && av_read_frame(formatContext, &packet) >= 0)
+	{
+		if (packet.stream_index == streamIndex)
+		{
+			int64_t pts = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+			if ((packet.flags & AV_PKT_FLAG_KEY) && pts != AV_NOPTS_VALUE)
+			{
+				Keyframe keyframe;
+				keyframe.pts = pts;
+				keyframe.pos = packet.pos;
+				keyframe.gopSize = 0;
+				found.push_back(keyframe);
+			}
+
+			if (!found.empty())
+			{
+				found.back().gopSize++;
+			}
+		}
+
+		av_packet_unref(&packet);
+	}
+
+	avformat_close_input(&formatContext);
+
+	if (*isAborted || found.empty())
+	{
+		return false;
+	}
+
+	std::sort(found.begin(), found.end(), [](const Keyframe& a, const Keyframe& b) { return a.pts < b.pts; });
+	keyframes.swap(found);
+	isReady = true;
+
+	LOG("Indexed %d keyframes. \n", (int)keyframes.size());
+
+	std::vector<uint8_t> data(sizeof(int32_t) + keyframes.size() * sizeof(Keyframe));
+	int32_t cachedStreamIndex = streamIndex;
+	memcpy(data.data(), &cachedStreamIndex, sizeof(int32_t));
+	memcpy(data.data() + sizeof(int32_t), keyframes.data(), keyframes.size() * sizeof(Keyframe));
+	FileCache::Save(filePath, CACHE_NAME, CACHE_VERSION, data);
+
+	return true;
+}
+
+bool KeyframeIndex::IsReady()
+{
+	return isReady;
+}
+
+//	Finds the last keyframe at or before the given pts.
+bool KeyframeIndex::Find(int64_t pts, Keyframe* keyframe)
+{
+	if (!isReady)
+	{
+		return false;
+	}
+
+	std::vector<Keyframe>::iterator next = std::upper_bound(keyframes.begin(), keyframes.end(), pts,
+		[](int64_t value, const Keyframe& keyframe) { return value < keyframe.pts; });
+	if (next == keyframes.begin())
+	{
+		return false;
+	}
+
+	*keyframe = *(next - 1);
+	return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * Positions of the keyframes of one video stream, so a seek can go straight
+ * to the right keyframe instead of letting the demuxer search for it.
+ *
+ * Load() or Build() runs once on a background thread. The other methods can
+ * be called from any thread, they don't see the index until it is complete.
+ */
+class KeyframeIndex
+{
+public:
+	struct Keyframe
+	{
+		int64_t		pts;		//	in the time base of the stream
+		int64_t		pos;		//	byte position of the packet, -1 if unknown
+		int32_t		gopSize;	//	packets from this keyframe up to the next one
+	};
+
+	KeyframeIndex();
+
+	bool Load(const char* filePath, int streamIndex);
+	bool Build(const char* filePath, int streamIndex, const std::atomic<bool>* isAborted);
+
+	bool IsReady();
+	bool Find(int64_t pts, Keyframe* keyframe);
+
+private:
+	std::vector<Keyframe>	keyframes;
+	std::atomic<bool>		isReady;
+};
@@ -1,92 +1,306 @@
 #include "Manager.h"
 #include "Decoder.h"
 
+//	Enough to present the first frame and keep going while the demux task starts up.
+static const unsigned int PREROLL_FRAMES = 3;
+
 Manager::Manager()
 {
 	playerState = UNINITIALIZED;
+	isAborted = false;
 	seekTime = 0.0;
+	seekGeneration = 0;
+	isSeekPending = false;
+	seeksRequested = 0;
+	seeksCoalesced = 0;
+	seeksCompleted = 0;
+	lastSettleTime = 0.0f;
 	decoder = new Decoder();
+	decoder->SetDemuxTask(&demuxTask);
+	issuedSeekGeneration = 0;
+	initSeconds = -1.0f;
+	firstFrameSeconds = -1.0f;
+	startToFirstFrameSeconds = -1.0f;
+	isPrerollEnabled = false;
+	lastCpuTime = 0.0;
+	lastCpuSample = std::chrono::steady_clock::now();
+	lastAllocationCount = 0;
+	lastAllocationSample = lastCpuSample;
 }
 
 Manager::~Manager()
 {
-	delete decoder;
 	Stop();
+	delete decoder;
+}
+
+void Manager::SetThreadingConfig(Decoder::ThreadingConfig config)
+{
+	if (decoder == NULL || playerState != UNINITIALIZED)
+	{
+		return;
+	}
+
+	decoder->SetThreadingConfig(config);
+}
+
+void Manager::SetFastOpen(bool isEnabled)
+{
+	if (decoder == NULL || playerState != UNINITIALIZED)
+	{
+		return;
+	}
+
+	decoder->SetFastOpen(isEnabled);
 }
 
+void Manager::SetAudioOutput(int sampleRate, bool isAllChannels)
+{
+	if (decoder == NULL || playerState != UNINITIALIZED)
+	{
+		return;
+	}
+
+	decoder->SetAudioOutput(sampleRate, isAllChannels);
+}
+
+//	Has to be called before Init().
+void Manager::SetPreroll(bool isEnabled)
+{
+	if (playerState != UNINITIALIZED)
+	{
+		return;
+	}
+
+	isPrerollEnabled = isEnabled;
+}
+
+/**
+ * Opens the file. With preroll enabled it also starts the decoder tasks and
+ * demuxes with the demux task until the first frames are decoded, then
+ * reports PREROLLED instead of INITIALIZED. Start() can present right away then.
+ * The preroll runs on the scheduler like playback, at the priority of the player.
+ * A Stop() that comes in meanwhile ends the preroll, and the state stays at STOP.
+ */
 void Manager::Init(const char* filePath)
 {
+	initStart = std::chrono::steady_clock::now();
+
 	if (decoder == NULL || !decoder->Init(filePath))
 	{
-		playerState = INIT_FAIL;
+		ChangePlayerState(UNINITIALIZED, INIT_FAIL);
 	}
 	else
 	{
-		playerState = INITIALIZED;
+		initSeconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - initStart).count();
+
+		if (isPrerollEnabled && decoder->GetVideoInfo().isEnabled)
+		{
+			//	Under the lock, so either Stop() sees the task and joins it, or the preroll sees the abort.
+			{
+				std::lock_guard<std::mutex> lock(stateMutex);
+				if (isAborted)
+				{
+					return;
+				}
+
+				decoder->Start();
+				demuxTask.Start([this] { return PrerollStep(); });
+			}
+
+			demuxTask.Join();
+			ChangePlayerState(UNINITIALIZED, PREROLLED);
+		}
+		else
+		{
+			ChangePlayerState(UNINITIALIZED, INITIALIZED);
+		}
 	}
 }
 
+void Manager::SetBufferLimits(int64_t maxBytes, double maxSeconds)
+{
+	if (decoder == NULL || !IsOpened())
+	{
+		return;
+	}
+
+	decoder->SetBufferLimits(maxBytes, maxSeconds);
+}
+
 void Manager::Start()
 {
-	if (decoder == NULL || 
+	if (decoder == NULL || isAborted ||
 		(playerState != INITIALIZED 
+			&& playerState != PREROLLED
 			&& playerState != PAUSE
 			&& playerState != STOP))
 	{
 		return;
 	}
-	
-	decodeThread = std::thread([&]() {
-			if (!(decoder->GetVideoInfo().isEnabled || decoder->GetAudioInfo().isEnabled))
+
+	startTime = std::chrono::steady_clock::now();
+
+	//	Already running after a preroll.
+	decoder->Start();
+
+	if (!(decoder->GetVideoInfo().isEnabled || decoder->GetAudioInfo().isEnabled))
+	{
+		return;
+	}
+
+	//	A seek that came in before the start is carried out first, the demux task issues it.
+	bool isSeeking;
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		isSeeking = isSeekPending;
+		isSeekPending = false;
+	}
+
+	//	This task only demuxes, the decoder runs a separate decode task for every stream.
+	//	After a pause it is still waiting, and the state change wakes it up.
+	SetPlayerState(isSeeking ? SEEK : PLAYING);
+	demuxTask.Start([this] { return DemuxStep(); });
+}
+
+//	The demux task before Start(), demuxes until the preroll frames are decoded.
+Scheduler::StepResult Manager::PrerollStep()
+{
+	if (isAborted || decoder->GetVideoFrameCount() >= PREROLL_FRAMES)
+	{
+		return Scheduler::STEP_DONE;
+	}
+
+	int result = decoder->Demux();
+	if (result == Decoder::DEMUX_END)
+	{
+		return Scheduler::STEP_DONE;
+	}
+
+	return result == Decoder::DEMUX_BLOCKED ? Scheduler::STEP_WAIT : Scheduler::STEP_AGAIN;
+}
+
+/**
+ * One step of the demux task, reads at most one packet. Waits while the
+ * packet queues are full, and in states without anything to demux.
+ */
+Scheduler::StepResult Manager::DemuxStep()
+{
+	switch (playerState)
+	{
+		case PLAYING:
+		{
+			int result = decoder->Demux();
+			if (result == Decoder::DEMUX_END)
+			{
+				ChangePlayerState(PLAYING, PLAY_EOF);
+			}
+
+			return result == Decoder::DEMUX_BLOCKED ? Scheduler::STEP_WAIT : Scheduler::STEP_AGAIN;
+		}
+		case SEEK:
+		{
+			double target;
+			int generation;
 			{
-				return;
+				std::lock_guard<std::mutex> lock(stateMutex);
+				target = seekTime;
+				generation = seekGeneration;
 			}
 
-			playerState = PLAYING;
+			//	Only the newest request is carried out, it also abandons a seek that is still decoding towards its target.
+			if (generation != issuedSeekGeneration)
+			{
+				decoder->Seek(target, generation);
+				issuedSeekGeneration = generation;
+			}
 
-			while (playerState != STOP)
+			//	Keep demuxing until the decoder has the frame at the target, so nothing from before it is shown.
+			if (decoder->GetSeekGeneration() == generation)
 			{
-				switch (playerState)
-				{
-					case PLAYING:
-						if (!decoder->Decode()) {
-							playerState = PLAY_EOF;
-						}
-
-
-						break;
-					case SEEK:
-						decoder->Seek(seekTime);
-						playerState = PLAYING;
-						break;
-					case PLAY_EOF:
-						break;
-				}
+				FinishSeek(generation, PLAYING);
+				return Scheduler::STEP_AGAIN;
 			}
-		});
+
+			int result = decoder->Demux();
+			if (result == Decoder::DEMUX_END)
+			{
+				FinishSeek(generation, PLAY_EOF);
+			}
+
+			return result == Decoder::DEMUX_BLOCKED ? Scheduler::STEP_WAIT : Scheduler::STEP_AGAIN;
+		}
+		case STOP:
+			return Scheduler::STEP_DONE;
+		default:
+			//	Nothing to demux in PLAY_EOF or PAUSE, a seek or stop wakes the task again.
+			return Scheduler::STEP_WAIT;
+	}
 }
 
 void Manager::Seek(float seconds)
 {
-	if (playerState < INITIALIZED || playerState == SEEK)
 	{
-		return;
+		std::lock_guard<std::mutex> lock(stateMutex);
+		if (!IsOpened())
+		{
+			return;
+		}
+
+		//	Scrubbing sends many seeks in a row, only the last one is worth decoding.
+		if (playerState == SEEK || isSeekPending)
+		{
+			seeksCoalesced++;
+		}
+		else
+		{
+			seekStart = std::chrono::steady_clock::now();
+		}
+
+		seeksRequested++;
+		seekTime = seconds;
+		seekGeneration++;
+
+		//	Without a demux task there is nobody to carry it out yet, Start() picks up the target.
+		if (!IsStarted())
+		{
+			isSeekPending = true;
+			return;
+		}
+
+		playerState = SEEK;
+		demuxTask.Wake();
 	}
 
-	seekTime = seconds;
-	playerState = SEEK;
+	if (decoder != NULL)
+	{
+		decoder->WakeDemux();
+	}
 }
 
 void Manager::Stop()
 {
-	playerState = STOP;
-	if (decodeThread.joinable())
 	{
-		decodeThread.join();
+		std::lock_guard<std::mutex> lock(stateMutex);
+		isAborted = true;
+		playerState = STOP;
+		demuxTask.Wake();
 	}
 
-	decoder = NULL;
-	playerState = UNINITIALIZED;
+	if (decoder != NULL)
+	{
+		decoder->WakeDemux();
+	}
+
+	demuxTask.Join();
+
+	if (decoder != NULL)
+	{
+		decoder->Stop();
+	}
+
+	//	The decoder stays around until the destructor, the render thread may still be reading its frames.
+	//	The state stays at STOP, the init thread may not have finished yet and must not take it for a fresh player.
 }
 
 Manager::PlayerState Manager::GetPlayerState()
@@ -94,26 +308,87 @@ Manager::PlayerState Manager::GetPlayerState()
 	return playerState;
 }
 
-double Manager::GetVideoFrame(uint8_t** outputY, uint8_t** outputU, uint8_t** outputV)
+//	The file is open and the player was not stopped. A prerolled player counts, it only waits for Start().
+bool Manager::IsOpened()
 {
-	if (decoder == NULL || !decoder->GetVideoInfo().isEnabled || playerState == SEEK)
+	switch (playerState)
+	{
+		case INITIALIZED:
+		case PREROLLED:
+			return true;
+		default:
+			return IsStarted();
+	}
+}
+
+//	Start() was called and the player was not stopped.
+bool Manager::IsStarted()
+{
+	switch (playerState)
+	{
+		case PLAYING:
+		case SEEK:
+		case BUFFERING:
+		case PLAY_EOF:
+		case PAUSE:
+			return true;
+		default:
+			return false;
+	}
+}
+
+double Manager::GetVideoFrame(uint8_t** outputY, uint8_t** outputU, uint8_t** outputV, int* outputLinesize)
+{
+	if (decoder == NULL || !decoder->GetVideoInfo().isEnabled)
 	{
 		*outputY = *outputU = *outputV = NULL;
 		return -1;
 	}
 
-	return decoder->GetVideoFrame(outputY, outputU, outputV);
+	if (playerState == SEEK)
+	{
+		decoder->DropStaleVideoFrames();
+		*outputY = *outputU = *outputV = NULL;
+		return -1;
+	}
+
+	double time = decoder->GetVideoFrame(outputY, outputU, outputV, outputLinesize);
+	if (time != -1 && firstFrameSeconds < 0)
+	{
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		firstFrameSeconds = std::chrono::duration<float>(now - initStart).count();
+		startToFirstFrameSeconds = std::chrono::duration<float>(now - startTime).count();
+	}
+
+	return time;
 }
 
-double Manager::GetAudioFrame(uint8_t** outputFrame, int& frameSize)
+/**
+ * Called from the audio thread. Plays silence while the player isn't running,
+ * but already lets the decoder fill the ring so playback starts with audio.
+ *
+ * @return the number of samples per channel that came from the stream.
+ */
+int Manager::GetAudioSamples(float* samples, int frameCount, int channels)
 {
-	if (decoder == NULL || !decoder->GetAudioInfo().isEnabled || playerState == SEEK)
+	if (decoder == NULL || frameCount <= 0 || channels <= 0)
 	{
-		*outputFrame = NULL;
-		return -1;
+		return 0;
 	}
 
-	return decoder->GetAudioFrame(outputFrame, frameSize);
+	PlayerState state = playerState;
+	if (state != PLAYING && state != PLAY_EOF)
+	{
+		if (state == SEEK)
+		{
+			decoder->DropStaleAudio();
+		}
+		decoder->SetAudioPulled();
+		memset(samples, 0, (size_t)frameCount * channels * sizeof(float));
+		return 0;
+	}
+
+	return decoder->GetAudioSamples(samples, (unsigned int)frameCount, (unsigned int)channels);
 }
 
 void Manager::FreeVideoFrame()
@@ -126,14 +401,15 @@ void Manager::FreeVideoFrame()
 }
 
 
-
-void Manager::FreeAudioFrame()
+//	Drops the frames that a slow renderer no longer has time to show.
+int Manager::SkipVideoFrames(double time)
 {
-	if (decoder == NULL || !decoder->GetAudioInfo().isEnabled || playerState == SEEK) {
-		return;
+	if (decoder == NULL || !decoder->GetVideoInfo().isEnabled || playerState == SEEK)
+	{
+		return 0;
 	}
 
-	decoder->FreeAudioFrame();
+	return decoder->SkipVideoFrames(time);
 }
 
 //void Manager::EnableVideo(bool isEnabled)
@@ -176,3 +452,175 @@ bool Manager::isVideoBufferFull()
 	Decoder::VideoInfo* videoInfo = &(decoder->GetVideoInfo());
 	return videoInfo->isEnabled && videoInfo->bufferState == Decoder::BufferState::FULL;
 }
+
+/**
+ * CPU usage of the demux and decoder tasks since the previous call, as a
+ * fraction of one core. Should stay close to zero while paused or at EOF.
+ */
+float Manager::GetDecodeCpuUsage()
+{
+	double cpuTime = demuxTask.GetCpuTime();
+	if (decoder != NULL)
+	{
+		cpuTime += decoder->GetThreadCpuTime();
+	}
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double wallTime = std::chrono::duration<double>(now - lastCpuSample).count();
+	double usage = wallTime > 0 && cpuTime >= lastCpuTime ? (cpuTime - lastCpuTime) / wallTime : 0;
+
+	lastCpuTime = cpuTime;
+	lastCpuSample = now;
+
+	return (float)usage;
+}
+
+//	CPU time of each task of the player since it was opened, in seconds.
+void Manager::GetTaskCpuTimes(double& demuxSeconds, double& videoSeconds, double& audioSeconds)
+{
+	demuxSeconds = demuxTask.GetCpuTime();
+	videoSeconds = audioSeconds = 0;
+	if (decoder != NULL)
+	{
+		decoder->GetTaskCpuTimes(videoSeconds, audioSeconds);
+	}
+}
+
+//	Heap allocations of frames and picture buffers per second since the previous call. Should drop to zero once the pools are warm.
+float Manager::GetAllocationsPerSecond()
+{
+	uint64_t allocationCount = decoder != NULL ? decoder->GetAllocationCount() : 0;
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double wallTime = std::chrono::duration<double>(now - lastAllocationSample).count();
+	double rate = wallTime > 0 && allocationCount >= lastAllocationCount ? (allocationCount - lastAllocationCount) / wallTime : 0;
+
+	lastAllocationCount = allocationCount;
+	lastAllocationSample = now;
+
+	return (float)rate;
+}
+
+//	When the scheduler is busy, tasks of players with a higher priority run first. E.g. the player in view over one that is preloading.
+void Manager::SetPriority(Scheduler::Priority priority)
+{
+	demuxTask.SetPriority(priority);
+	if (decoder != NULL)
+	{
+		decoder->SetPriority(priority);
+	}
+}
+
+void Manager::SetSyncMaster(Decoder::SyncMaster master)
+{
+	if (decoder != NULL)
+	{
+		decoder->SetSyncMaster(master);
+	}
+}
+
+void Manager::SetPlaybackSpeed(double speed)
+{
+	if (decoder != NULL)
+	{
+		decoder->SetPlaybackSpeed(speed);
+	}
+}
+
+void Manager::SetLoop(bool isEnabled, double startTime)
+{
+	if (decoder != NULL)
+	{
+		decoder->SetLoop(isEnabled, startTime);
+	}
+}
+
+//	The time of the video that should be on screen now, -1 until the first frame after a start or seek was shown.
+double Manager::GetPresentationTime()
+{
+	return decoder != NULL ? decoder->GetMasterClock() : -1;
+}
+
+void Manager::GetDroppedFrames(int& droppedFrames, int& skippedFrames)
+{
+	droppedFrames = decoder != NULL ? decoder->GetDroppedFrames() : 0;
+	skippedFrames = decoder != NULL ? decoder->GetSkippedFrames() : 0;
+}
+
+void Manager::GetConvertStats(int& convertedFrames, double& totalSeconds, double& lastSeconds)
+{
+	convertedFrames = 0;
+	totalSeconds = lastSeconds = 0;
+	if (decoder != NULL)
+	{
+		decoder->GetConvertStats(convertedFrames, totalSeconds, lastSeconds);
+	}
+}
+
+void Manager::GetAudioStats(int& underruns, int& overruns)
+{
+	underruns = overruns = 0;
+	if (decoder != NULL)
+	{
+		decoder->GetAudioStats(underruns, overruns);
+	}
+}
+
+//	The newest seek whose target frame is queued. The seek is over once this catches up with the last request.
+int Manager::GetSeekGeneration()
+{
+	return decoder != NULL ? decoder->GetSeekGeneration() : 0;
+}
+
+//	Time to settle is measured from the first request of a burst of seeks until the frame at the last target is queued.
+void Manager::GetSeekStats(int& requested, int& coalesced, int& completed, float& lastSettleTime)
+{
+	requested = seeksRequested;
+	coalesced = seeksCoalesced;
+	completed = seeksCompleted;
+	lastSettleTime = this->lastSettleTime;
+}
+
+//	Seconds from the start of Init until the player was initialized and until the first frame reached the render thread,
+//	and from Start() until that first frame.
+void Manager::GetStartupTimes(float& initSeconds, float& firstFrameSeconds, float& startToFirstFrameSeconds)
+{
+	initSeconds = this->initSeconds;
+	firstFrameSeconds = this->firstFrameSeconds;
+	startToFirstFrameSeconds = this->startToFirstFrameSeconds;
+}
+
+void Manager::SetPlayerState(PlayerState state)
+{
+	std::lock_guard<std::mutex> lock(stateMutex);
+	playerState = state;
+	demuxTask.Wake();
+}
+
+//	Only switches when nobody changed the state in the meantime, so a seek or stop that came in is not lost.
+//	Leaves SEEK, unless a newer request came in while the decoder was busy with this one.
+void Manager::FinishSeek(int generation, PlayerState to)
+{
+	std::lock_guard<std::mutex> lock(stateMutex);
+	if (playerState != SEEK || generation != seekGeneration)
+	{
+		return;
+	}
+
+	playerState = to;
+	demuxTask.Wake();
+
+	seeksCompleted++;
+	lastSettleTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - seekStart).count();
+}
+
+//	Nothing changes after Stop(), whoever is still running finds the player at STOP.
+void Manager::ChangePlayerState(PlayerState from, PlayerState to)
+{
+	std::lock_guard<std::mutex> lock(stateMutex);
+	if (playerState == from && !isAborted)
+	{
+		playerState = to;
+		demuxTask.Wake();
+	}
+}
\ No newline at end of file
@@ -2,6 +2,9 @@
 #include "Decoder.h"
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 #include <memory>
 
 class Manager
@@ -20,19 +23,32 @@ public:
 		BUFFERING, 
 		PLAY_EOF, 
 		STOP,
-		PAUSE
+		PAUSE,
+		PREROLLED
 	};
 
+	void SetThreadingConfig(Decoder::ThreadingConfig config);
+	void SetFastOpen(bool isEnabled);
+	void SetPreroll(bool isEnabled);
+	void SetAudioOutput(int sampleRate, bool isAllChannels);
 	void Init(const char* filePath);
+	void SetBufferLimits(int64_t maxBytes, double maxSeconds);
 	void Start();
 	void Stop();
 	void Seek(float seconds);
+	void SetPriority(Scheduler::Priority priority);
+	void SetSyncMaster(Decoder::SyncMaster master);
+	void SetPlaybackSpeed(double speed);
+	void SetLoop(bool isEnabled, double startTime);
+	double GetPresentationTime();
 
 	PlayerState GetPlayerState();
-	double GetVideoFrame(uint8_t** outputY, uint8_t** outputU, uint8_t** outputV);
-	double GetAudioFrame(uint8_t** outputFrame, int& frameSize);
+	bool IsOpened();
+	bool IsStarted();
+	double GetVideoFrame(uint8_t** outputY, uint8_t** outputU, uint8_t** outputV, int* outputLinesize);
+	int GetAudioSamples(float* samples, int frameCount, int channels);
 	void FreeVideoFrame();
-	void FreeAudioFrame();
+	int SkipVideoFrames(double time);
 	void EnableVideo(bool isEnabled);
 	void EnableAudio(bool isEnabled);
 
@@ -40,11 +56,54 @@ public:
 	Decoder::AudioInfo getAudioInfo();
 	bool isVideoBufferEmpty();
 	bool isVideoBufferFull();
+	float GetDecodeCpuUsage();
+	void GetTaskCpuTimes(double& demuxSeconds, double& videoSeconds, double& audioSeconds);
+	float GetAllocationsPerSecond();
+	void GetDroppedFrames(int& droppedFrames, int& skippedFrames);
+	void GetConvertStats(int& convertedFrames, double& totalSeconds, double& lastSeconds);
+	void GetAudioStats(int& underruns, int& overruns);
+	int GetSeekGeneration();
+	void GetSeekStats(int& requested, int& coalesced, int& completed, float& lastSettleTime);
+	void GetStartupTimes(float& initSeconds, float& firstFrameSeconds, float& startToFirstFrameSeconds);
 
 private:
-	PlayerState playerState;
+	std::atomic<PlayerState> playerState;
+	//	Set by Stop(), before anything else. An init thread that is still opening or prerolling gives up on it.
+	std::atomic<bool> isAborted;
 	Decoder* decoder;
+	//	The newest seek request, guarded by stateMutex. Requests that come in while seeking replace it.
 	double seekTime;
+	int seekGeneration;
+	//	A seek that came in before Start(), also guarded by stateMutex.
+	bool isSeekPending;
+	std::chrono::steady_clock::time_point seekStart;
+	std::atomic<int> seeksRequested;
+	std::atomic<int> seeksCoalesced;
+	std::atomic<int> seeksCompleted;
+	std::atomic<float> lastSettleTime;
 
-	std::thread decodeThread;
+	//	Demuxes on the shared scheduler, next to the decoder tasks of this and every other player.
+	Scheduler::Task demuxTask;
+	int issuedSeekGeneration;
+	std::mutex stateMutex;
+
+	//	Startup latency, -1 until reached.
+	std::chrono::steady_clock::time_point initStart;
+	std::atomic<float> initSeconds;
+	std::atomic<float> firstFrameSeconds;
+	std::chrono::steady_clock::time_point startTime;
+	std::atomic<float> startToFirstFrameSeconds;
+
+	bool isPrerollEnabled;
+
+	double lastCpuTime;
+	std::chrono::steady_clock::time_point lastCpuSample;
+	uint64_t lastAllocationCount;
+	std::chrono::steady_clock::time_point lastAllocationSample;
+
+	void SetPlayerState(PlayerState state);
+	void ChangePlayerState(PlayerState from, PlayerState to);
+	void FinishSeek(int generation, PlayerState to);
+	Scheduler::StepResult PrerollStep();
+	Scheduler::StepResult DemuxStep();
 };
\ No newline at end of file
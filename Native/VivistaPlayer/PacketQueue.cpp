@@ -0,0 +1,213 @@
+#include "PacketQueue.h"
+
+static uint8_t flushData[] = "FLUSH";
+
+PacketQueue::PacketQueue()
+{
+	size = 0;
+	maxSize = 0;
+	maxCount = 0;
+	serial = 0;
+	isAborted = true;
+	consumer = NULL;
+}
+
+PacketQueue::~PacketQueue()
+{
+	Flush();
+}
+
+void PacketQueue::Init(int maxSize, int maxCount)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	this->maxSize = maxSize;
+	this->maxCount = maxCount;
+}
+
+//	The task that takes the packets out, it is woken whenever the queue changes.
+void PacketQueue::SetConsumer(Scheduler::Task* consumer)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	this->consumer = consumer;
+}
+
+void PacketQueue::Start()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	isAborted = false;
+}
+
+// Wakes up every thread waiting in Get(). They will return ABORTED until Start() is called again.
+void PacketQueue::Abort()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isAborted = true;
+		cond.notify_all();
+	}
+	WakeConsumer();
+}
+
+/**
+ * Moves the reference of the given packet into the queue. The caller keeps
+ * ownership of the AVPacket struct itself, which is reset on success.
+ *
+ * @return false if the packet could not be queued, also once the queue is aborted.
+ */
+bool PacketQueue::Put(AVPacket* packet)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (isAborted)
+		{
+			return false;
+		}
+
+		AVPacket* queued = av_packet_alloc();
+		if (queued == NULL)
+		{
+			return false;
+		}
+		av_packet_move_ref(queued, packet);
+
+		packets.push(queued);
+		size += queued->size;
+		cond.notify_one();
+	}
+	WakeConsumer();
+
+	return true;
+}
+
+// Everything that is still queued belongs to the old position, so drop it and tell the decoder
+// thread to flush its codec. Bumping the serial lets that thread recognize packets it took out before the flush.
+bool PacketQueue::PutFlush()
+{
+	AVPacket* queued = av_packet_alloc();
+	if (queued == NULL)
+	{
+		return false;
+	}
+	queued->data = flushData;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		FlushLocked();
+		serial++;
+		packets.push(queued);
+		cond.notify_one();
+	}
+	WakeConsumer();
+
+	return true;
+}
+
+// A packet without data tells the decoder thread that the input ended, so it can drain its codec.
+bool PacketQueue::PutNullPacket()
+{
+	AVPacket nullPacket;
+	av_init_packet(&nullPacket);
+	nullPacket.data = NULL;
+	nullPacket.size = 0;
+
+	return Put(&nullPacket);
+}
+
+/**
+ * Get the first AVPacket from the queue.
+ *
+ * @param   packet  receives the reference of the first packet in the queue
+ * @param   block   wait for a packet to be inserted if the queue is empty
+ * @param   serial  optionally receives the serial of the queue at the time of the get
+ *
+ * @return  ABORTED if the queue was aborted, EMPTY if there was no packet, AVAILABLE otherwise
+ */
+int PacketQueue::Get(AVPacket* packet, bool block, int* serial)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (!isAborted && packets.empty() && block)
+	{
+		cond.wait(lock);
+	}
+
+	if (isAborted)
+	{
+		return ABORTED;
+	}
+
+	if (packets.empty())
+	{
+		return EMPTY;
+	}
+
+	AVPacket* queued = packets.front();
+	packets.pop();
+	size -= queued->size;
+
+	av_packet_move_ref(packet, queued);
+	av_packet_free(&queued);
+
+	if (serial != NULL)
+	{
+		*serial = this->serial;
+	}
+
+	return AVAILABLE;
+}
+
+void PacketQueue::Flush()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	FlushLocked();
+}
+
+// An empty queue is never full, so a single packet bigger than maxSize can still get through.
+bool PacketQueue::IsFull()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return !packets.empty() && (size >= maxSize || (int)packets.size() >= maxCount);
+}
+
+int PacketQueue::GetSize()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return size;
+}
+
+int PacketQueue::GetCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return (int)packets.size();
+}
+
+// Lock free, so the render thread can check the serial of a frame without waiting on the demux stage.
+int PacketQueue::GetSerial()
+{
+	return serial;
+}
+
+bool PacketQueue::IsFlushPacket(const AVPacket* packet)
+{
+	return packet->data == flushData;
+}
+
+//	Outside the lock, the consumer may already be running and take the mutex in Get().
+void PacketQueue::WakeConsumer()
+{
+	if (consumer != NULL)
+	{
+		consumer->Wake();
+	}
+}
+
+void PacketQueue::FlushLocked()
+{
+	while (!packets.empty())
+	{
+		AVPacket* queued = packets.front();
+		av_packet_free(&queued);
+		packets.pop();
+	}
+	size = 0;
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "Scheduler.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// C++ port of the PacketQueue from main.c. The demux stage puts packets in, every stream
+// has its own decoder task that takes them out again.
+class PacketQueue
+{
+public:
+	PacketQueue();
+	~PacketQueue();
+
+	enum GetResult { ABORTED = -1, EMPTY, AVAILABLE };
+
+	void Init(int maxSize, int maxCount);
+	void SetConsumer(Scheduler::Task* consumer);
+	void Start();
+	void Abort();
+
+	bool Put(AVPacket* packet);
+	bool PutFlush();
+	bool PutNullPacket();
+	int Get(AVPacket* packet, bool block, int* serial = NULL);
+	void Flush();
+
+	bool IsFull();
+	int GetSize();
+	int GetCount();
+	int GetSerial();
+
+	static bool IsFlushPacket(const AVPacket* packet);
+
+private:
+	std::queue<AVPacket*>	packets;
+	int						size;
+	int						maxSize;
+	int						maxCount;
+	std::atomic<int>		serial;
+	bool					isAborted;
+	Scheduler::Task*		consumer;
+
+	std::mutex				mutex;
+	std::condition_variable	cond;
+
+	void WakeConsumer();
+	void FlushLocked();
+};
\ No newline at end of file
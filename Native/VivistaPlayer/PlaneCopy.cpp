@@ -0,0 +1,142 @@
+#include "PlaneCopy.h"
+
+#include <cstring>
+
+extern "C" {
+#include <libavutil/cpu.h>
+}
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PLANE_COPY_X86 1
+#include <immintrin.h>
+#endif
+
+//	MSVC lets any function use the AVX2 intrinsics, GCC and Clang only the ones marked for it.
+#if PLANE_COPY_X86 && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+//	Shorter rows are not worth lining up for the streaming stores.
+static const int MIN_STREAM_WIDTH = 256;
+
+typedef void(*CopyRowFunc)(uint8_t* dst, const uint8_t* src, int width);
+
+static void CopyRowMemcpy(uint8_t* dst, const uint8_t* src, int width)
+{
+	memcpy(dst, src, width);
+}
+
+#if PLANE_COPY_X86
+
+//	The streaming stores need an aligned destination, the source can be anywhere. The unaligned head and the tail go through memcpy.
+static void CopyRowSSE2(uint8_t* dst, const uint8_t* src, int width)
+{
+	int head = (int)((16 - ((uintptr_t)dst & 15)) & 15);
+	memcpy(dst, src, head);
+
+	int i = head;
+	for (; i + 64 <= width; i += 64)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(src + i + 16));
+		__m128i c = _mm_loadu_si128((const __m128i*)(src + i + 32));
+		__m128i d = _mm_loadu_si128((const __m128i*)(src + i + 48));
+		_mm_stream_si128((__m128i*)(dst + i), a);
+		_mm_stream_si128((__m128i*)(dst + i + 16), b);
+		_mm_stream_si128((__m128i*)(dst + i + 32), c);
+		_mm_stream_si128((__m128i*)(dst + i + 48), d);
+	}
+	for (; i + 16 <= width; i += 16)
+	{
+		_mm_stream_si128((__m128i*)(dst + i), _mm_loadu_si128((const __m128i*)(src + i)));
+	}
+
+	memcpy(dst + i, src + i, width - i);
+}
+
+TARGET_AVX2 static void CopyRowAVX2(uint8_t* dst, const uint8_t* src, int width)
+{
+	int head = (int)((32 - ((uintptr_t)dst & 31)) & 31);
+	memcpy(dst, src, head);
+
+	int i = head;
+	for (; i + 128 <= width; i += 128)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(src + i + 32));
+		__m256i c = _mm256_loadu_si256((const __m256i*)(src + i + 64));
+		__m256i d = _mm256_loadu_si256((const __m256i*)(src + i + 96));
+		_mm256_stream_si256((__m256i*)(dst + i), a);
+		_mm256_stream_si256((__m256i*)(dst + i + 32), b);
+		_mm256_stream_si256((__m256i*)(dst + i + 64), c);
+		_mm256_stream_si256((__m256i*)(dst + i + 96), d);
+	}
+	for (; i + 32 <= width; i += 32)
+	{
+		_mm256_stream_si256((__m256i*)(dst + i), _mm256_loadu_si256((const __m256i*)(src + i)));
+	}
+
+	memcpy(dst + i, src + i, width - i);
+}
+
+#endif // PLANE_COPY_X86
+
+//	Picked once, by what FFmpeg detected about the CPU.
+static CopyRowFunc GetStreamingCopyRow()
+{
+#if PLANE_COPY_X86
+	int flags = av_get_cpu_flags();
+	if (flags & AV_CPU_FLAG_AVX2)
+	{
+		return CopyRowAVX2;
+	}
+	if (flags & AV_CPU_FLAG_SSE2)
+	{
+		return CopyRowSSE2;
+	}
+#endif
+	return NULL;
+}
+
+void CopyPlane(uint8_t* dst, int dstPitch, const uint8_t* src, int srcPitch, int width, int height, bool isWriteCombined)
+{
+	if (dst == NULL || src == NULL || width <= 0 || height <= 0)
+	{
+		return;
+	}
+
+	static const CopyRowFunc streamingCopyRow = GetStreamingCopyRow();
+
+	//	Without padding on either side the plane is one long row.
+	if (dstPitch == width && srcPitch == width)
+	{
+		width *= height;
+		height = 1;
+	}
+
+	CopyRowFunc copyRow = isWriteCombined && streamingCopyRow != NULL && width >= MIN_STREAM_WIDTH ? streamingCopyRow : CopyRowMemcpy;
+	for (int y = 0; y < height; y++)
+	{
+		copyRow(dst + (intptr_t)y * dstPitch, src + (intptr_t)y * srcPitch, width);
+	}
+
+#if PLANE_COPY_X86
+	//	The streaming stores are weakly ordered, they have to land before the texture is unmapped.
+	if (copyRow != CopyRowMemcpy)
+	{
+		_mm_sfence();
+	}
+#endif
+}
+
+void CopyYUVAtlas(uint8_t* dst, int dstPitch, const uint8_t* y, const uint8_t* u, const uint8_t* v, const int* srcPitch, int width, int height,
+	bool isWriteCombined)
+{
+	uint8_t* chroma = dst + (intptr_t)height * dstPitch;
+
+	CopyPlane(dst, dstPitch, y, srcPitch[0], width, height, isWriteCombined);
+	CopyPlane(chroma, dstPitch, u, srcPitch[1], width / 2, height / 2, isWriteCombined);
+	CopyPlane(chroma + width / 2, dstPitch, v, srcPitch[2], width / 2, height / 2, isWriteCombined);
+}
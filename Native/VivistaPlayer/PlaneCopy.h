@@ -0,0 +1,15 @@
+#pragma once
+#include <stdint.h>
+
+// Copies of picture planes into texture memory.
+
+// Copies width bytes of height rows from src to dst, each side with its own pitch (linesize) in bytes.
+// Plain memcpy, unless dst is write-combined, like texture memory mapped for writing. Large rows go through
+// non-temporal stores then, when the CPU has them: the frame won't be read back by the CPU, so it is not worth
+// keeping in the cache. Into ordinary memory the streaming stores would only be slower.
+void CopyPlane(uint8_t* dst, int dstPitch, const uint8_t* src, int srcPitch, int width, int height, bool isWriteCombined = false);
+
+// Copies the planes of a yuv420p picture of width x height into one atlas of width x (height + height / 2):
+// Y at the top, U and V side by side below it.
+void CopyYUVAtlas(uint8_t* dst, int dstPitch, const uint8_t* y, const uint8_t* u, const uint8_t* v, const int* srcPitch, int width, int height,
+	bool isWriteCombined = false);
@@ -62,6 +62,11 @@
 	#define SUPPORT_METAL 1
 #endif
 
+// Uploads into CPU memory when there is no graphics device, e.g. in batch mode or on a build machine.
+#ifndef SUPPORT_SOFTWARE
+	#define SUPPORT_SOFTWARE 1
+#endif
+
 // COM-like Release macro
 #ifndef SAFE_RELEASE
 	#define SAFE_RELEASE(a) if (a) { a->Release(); a = NULL; }
@@ -0,0 +1,279 @@
+#include "ProbeCache.h"
+#include "FileCache.h"
+#include "Logger.h"
+#include <vector>
+#include <string.h>
+
+static const char* CACHE_NAME = "probe";
+static const uint32_t CACHE_VERSION = 1;
+
+//	Everything the decoder needs from a probed stream, followed by extradataSize bytes of extradata.
+struct StreamRecord
+{
+	int32_t			codecType;
+	int32_t			codecId;
+	uint32_t		codecTag;
+	int32_t			format;
+	int64_t			bitRate;
+	int32_t			bitsPerCodedSample;
+	int32_t			bitsPerRawSample;
+	int32_t			profile;
+	int32_t			level;
+	int32_t			width;
+	int32_t			height;
+	AVRational		sampleAspectRatio;
+	int32_t			fieldOrder;
+	int32_t			colorRange;
+	int32_t			colorPrimaries;
+	int32_t			colorTrc;
+	int32_t			colorSpace;
+	int32_t			chromaLocation;
+	int32_t			videoDelay;
+	uint64_t		channelLayout;
+	int32_t			channels;
+	int32_t			sampleRate;
+	int32_t			blockAlign;
+	int32_t			frameSize;
+	int32_t			initialPadding;
+	int32_t			extradataSize;
+	AVRational		timeBase;
+	AVRational		avgFrameRate;
+	AVRational		realFrameRate;
+	int64_t			startTime;
+	int64_t			duration;
+};
+
+struct ContextRecord
+{
+	int32_t			streamCount;
+	int64_t			startTime;
+	int64_t			duration;
+};
+
+static void Append(std::vector<uint8_t>* data, const void* source, size_t size)
+{
+	const uint8_t* bytes = (const uint8_t*)source;
+	data->insert(data->end(), bytes, bytes + size);
+}
+
+static bool Consume(const std::vector<uint8_t>& data, size_t* offset, void* destination, size_t size)
+{
+	if (data.size() - *offset < size)
+	{
+		return false;
+	}
+
+	memcpy(destination, data.data() + *offset, size);
+	*offset += size;
+	return true;
+}
+
+/**
+ * Fills in the streams of a freshly opened input from the cache.
+ *
+ * @return false if there is no entry for this file, or it doesn't match the
+ *         streams the demuxer found, the input is left untouched then.
+ */
+bool ProbeCache::Load(const char* filePath, AVFormatContext* formatContext)
+{
+	std::vector<uint8_t> data;
+	if (!FileCache::Load(filePath, CACHE_NAME, CACHE_VERSION, &data))
+	{
+		return false;
+	}
+
+	size_t offset = 0;
+	ContextRecord context;
+	if (!Consume(data, &offset, &context, sizeof(context)) || context.streamCount != (int32_t)formatContext->nb_streams)
+	{
+		return false;
+	}
+
+	//	Check everything before touching the streams, a bad entry must not leave them half filled in.
+	std::vector<StreamRecord> records(context.streamCount);
+	std::vector<size_t> extradataOffsets(context.streamCount);
+	for (int i = 0; i < context.streamCount; i++)
+	{
+		if (!Consume(data, &offset, &records[i], sizeof(StreamRecord)) || records[i].extradataSize < 0)
+		{
+			return false;
+		}
+
+		AVStream* stream = formatContext->streams[i];
+		AVCodecParameters* codecpar = stream->codecpar;
+		if (codecpar->codec_type != records[i].codecType
+			|| (codecpar->codec_id != AV_CODEC_ID_NONE && codecpar->codec_id != records[i].codecId)
+			|| av_cmp_q(stream->time_base, records[i].timeBase) != 0)
+		{
+			return false;
+		}
+
+		extradataOffsets[i] = offset;
+		if (data.size() - offset < (size_t)records[i].extradataSize)
+		{
+			return false;
+		}
+		offset += records[i].extradataSize;
+	}
+
+	for (int i = 0; i < context.streamCount; i++)
+	{
+		const StreamRecord& record = records[i];
+		AVStream* stream = formatContext->streams[i];
+		AVCodecParameters* codecpar = stream->codecpar;
+
+		codecpar->codec_id = (AVCodecID)record.codecId;
+		codecpar->codec_tag = record.codecTag;
+		codecpar->format = record.format;
+		codecpar->bit_rate = record.bitRate;
+		codecpar->bits_per_coded_sample = record.bitsPerCodedSample;
+		codecpar->bits_per_raw_sample = record.bitsPerRawSample;
+		codecpar->profile = record.profile;
+		codecpar->level = record.level;
+		codecpar->width = record.width;
+		codecpar->height = record.height;
+		codecpar->sample_aspect_ratio = record.sampleAspectRatio;
+		codecpar->field_order = (AVFieldOrder)record.fieldOrder;
+		codecpar->color_range = (AVColorRange)record.colorRange;
+		codecpar->color_primaries = (AVColorPrimaries)record.colorPrimaries;
+		codecpar->color_trc = (AVColorTransferCharacteristic)record.colorTrc;
+		codecpar->color_space = (AVColorSpace)record.colorSpace;
+		codecpar->chroma_location = (AVChromaLocation)record.chromaLocation;
+		codecpar->video_delay = record.videoDelay;
+		codecpar->channel_layout = record.channelLayout;
+		codecpar->channels = record.channels;
+		codecpar->sample_rate = record.sampleRate;
+		codecpar->block_align = record.blockAlign;
+		codecpar->frame_size = record.frameSize;
+		codecpar->initial_padding = record.initialPadding;
+
+		av_freep(&codecpar->extradata);
+		codecpar->extradata_size = 0;
+		if (record.extradataSize > 0)
+		{
+			codecpar->extradata = (uint8_t*)av_mallocz(record.extradataSize + AV_INPUT_BUFFER_PADDING_SIZE);
+			if (codecpar->extradata != NULL)
+			{
+				memcpy(codecpar->extradata, data.data() + extradataOffsets[i], record.extradataSize);
+				codecpar->extradata_size = record.extradataSize;
+			}
+		}
+
+		stream->avg_frame_rate = record.avgFrameRate;
+		stream->r_frame_rate = record.realFrameRate;
+		if (stream->start_time == AV_NOPTS_VALUE)
+		{
+			stream->start_time = record.startTime;
+		}
+		if (stream->duration == AV_NOPTS_VALUE || stream->duration <= 0)
+		{
+			stream->duration = record.duration;
+		}
+	}
+
+	if (formatContext->start_time == AV_NOPTS_VALUE)
+	{
+		formatContext->start_time = context.startTime;
+	}
+	if (formatContext->duration == AV_NOPTS_VALUE || formatContext->duration <= 0)
+	{
+		formatContext->duration = context.duration;
+	}
+
+	LOG("Stream parameters loaded from the cache. \n");
+	return true;
+}
+
+//	Stores the streams of an input that went through avformat_find_stream_info().
+bool ProbeCache::Save(const char* filePath, AVFormatContext* formatContext)
+{
+	std::vector<uint8_t> data;
+
+	ContextRecord context;
+	memset(&context, 0, sizeof(context));
+	context.streamCount = formatContext->nb_streams;
+	context.startTime = formatContext->start_time;
+	context.duration = formatContext->duration;
+	Append(&data, &context, sizeof(context));
+
+	for (unsigned int i = 0; i < formatContext->nb_streams; i++)
+	{
+		AVStream* stream = formatContext->streams[i];
+		AVCodecParameters* codecpar = stream->codecpar;
+
+		StreamRecord record;
+		memset(&record, 0, sizeof(record));
+		record.codecType = codecpar->codec_type;
+		record.codecId = codecpar->codec_id;
+		record.codecTag = codecpar->codec_tag;
+		record.format = codecpar->format;
+		record.bitRate = codecpar->bit_rate;
+		record.bitsPerCodedSample = codecpar->bits_per_coded_sample;
+		record.bitsPerRawSample = codecpar->bits_per_raw_sample;
+		record.profile = codecpar->profile;
+		record.level = codecpar->level;
+		record.width = codecpar->width;
+		record.height = codecpar->height;
+		record.sampleAspectRatio = codecpar->sample_aspect_ratio;
+		record.fieldOrder = codecpar->field_order;
+		record.colorRange = codecpar->color_range;
+		record.colorPrimaries = codecpar->color_primaries;
+		record.colorTrc = codecpar->color_trc;
+		record.colorSpace = codecpar->color_space;
+		record.chromaLocation = codecpar->chroma_location;
+		record.videoDelay = codecpar->video_delay;
+		record.channelLayout = codecpar->channel_layout;
+		record.channels = codecpar->channels;
+		record.sampleRate = codecpar->sample_rate;
+		record.blockAlign = codecpar->block_align;
+		record.frameSize = codecpar->frame_size;
+		record.initialPadding = codecpar->initial_padding;
+		record.extradataSize = codecpar->extradata != NULL ? codecpar->extradata_size : 0;
+		record.timeBase = stream->time_base;
+		record.avgFrameRate = stream->avg_frame_rate;
+		record.realFrameRate = stream->r_frame_rate;
+		record.startTime = stream->start_time;
+		record.duration = stream->duration;
+
+		Append(&data, &record, sizeof(record));
+		Append(&data, codecpar->extradata, record.extradataSize);
+	}
+
+	return FileCache::Save(filePath, CACHE_NAME, CACHE_VERSION, data);
+}
+
+/**
+ * Containers like MP4 and MKV describe their streams in the header. When the
+ * decoders can be opened from that alone, probing the packets is not needed.
+ */
+bool ProbeCache::IsHeaderSufficient(AVFormatContext* formatContext)
+{
+	if (formatContext->nb_streams == 0 || (formatContext->ctx_flags & AVFMTCTX_NOHEADER))
+	{
+		return false;
+	}
+
+	for (unsigned int i = 0; i < formatContext->nb_streams; i++)
+	{
+		AVCodecParameters* codecpar = formatContext->streams[i]->codecpar;
+		switch (codecpar->codec_type)
+		{
+			case AVMEDIA_TYPE_VIDEO:
+				if (codecpar->codec_id == AV_CODEC_ID_NONE || codecpar->width <= 0 || codecpar->height <= 0)
+				{
+					return false;
+				}
+				break;
+			case AVMEDIA_TYPE_AUDIO:
+				if (codecpar->codec_id == AV_CODEC_ID_NONE || codecpar->sample_rate <= 0 || codecpar->channels <= 0)
+				{
+					return false;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	return formatContext->duration != AV_NOPTS_VALUE;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+/**
+ * Remembers what avformat_find_stream_info() found out about a file, so the
+ * next open of the same file can skip probing. Stored with FileCache, so an
+ * entry is dropped as soon as the file changes.
+ */
+class ProbeCache
+{
+public:
+	static bool Load(const char* filePath, AVFormatContext* formatContext);
+	static bool Save(const char* filePath, AVFormatContext* formatContext);
+	static bool IsHeaderSufficient(AVFormatContext* formatContext);
+};
@@ -12,6 +12,14 @@ RenderAPI* CreateRenderAPI(UnityGfxRenderer apiType)
 	}
 #	endif // if SUPPORT_D3D11
 
+#	if SUPPORT_SOFTWARE
+	if (apiType == kUnityGfxRendererNull)
+	{
+		extern RenderAPI* CreateRenderAPI_Software();
+		return CreateRenderAPI_Software();
+	}
+#	endif // if SUPPORT_SOFTWARE
+
 //#	if SUPPORT_OPENGL_UNIFIED
 //	if (apiType == kUnityGfxRendererOpenGLCore || apiType == kUnityGfxRendererOpenGLES20 || apiType == kUnityGfxRendererOpenGLES30)
 //	{
@@ -3,12 +3,37 @@
 #include "Unity/IUnityGraphics.h"
 
 #include <stddef.h>
+#include <stdint.h>
 
 struct IUnityInterface;
 
+// How a player's picture is laid out in its textures. PLANES uses one A8 texture per plane. ATLAS uses a single A8 texture of
+// width x (height + height / 2) with Y at the top and U and V side by side below it, so a frame is uploaded with one Map.
+enum YUVLayout { YUV_PLANES = 0, YUV_ATLAS = 1 };
+
+// The textures of one player. Every graphics API derives its own, deleting it releases the GPU resources.
+struct YUVTextures
+{
+	virtual ~YUVTextures() {}
+};
+
+// What the uploads into the textures of one player cost so far
+struct UploadStats
+{
+	int uploadCount;
+	int64_t uploadBytes;
+	double totalSeconds;
+	double maxSeconds;
+	// Calls into the graphics driver, each Map and Unmap counts as one
+	int driverCalls;
+};
+
 class RenderAPI
 {
 public:
+	// The plugin deletes the backend through this interface at device shutdown
+	virtual ~RenderAPI() {}
+
 	// Process general event like initialization, shutdown, device loss/reset etc.
 	virtual void ProcessDeviceEvent(UnityGfxDeviceEventType type, IUnityInterfaces* interfaces) = 0;
 
@@ -16,14 +41,18 @@ public:
 	// Reversed Z is used on modern platforms, and improves depth buffer precision.
 	virtual bool GetUsesReverseZ() = 0;
 
-	// Create a new texture on the GPU You need to pass texture width/height too, since some graphics APIs
+	// Create the Y, U and V textures of one player on the GPU. You need to pass texture width/height too, since some graphics APIs
 	// (e.g. OpenGL ES) do not have a good way to query that from the texture itself...
 	//
-	// Returns pointer into the data buffer to write into (or NULL on failure), and pitch in bytes of a single texture row.
-	virtual void Create(int textureWidth, int textureHeight, void** ptry, void** ptru, void** ptrv) = 0;
+	// Returns the native texture pointers for Unity, and the textures to upload into (NULL on failure). The caller owns those.
+	// With YUV_ATLAS only ptry is set, the others are NULL.
+	virtual YUVTextures* Create(int textureWidth, int textureHeight, YUVLayout layout, void** ptry, void** ptru, void** ptrv) = 0;
+
+	// Upload new texture data to the textures of a player. linesize holds the pitch of the Y, U and V planes in bytes, like AVFrame::linesize.
+	virtual void UploadYUVFrame(YUVTextures* textures, unsigned char* ych, unsigned char* uch, unsigned char* vch, const int* linesize) = 0;
 
-	// Upload new texture data to an existing texture resource.
-	virtual void UploadYUVFrame(unsigned char* ych, unsigned char* uch, unsigned char* vch) = 0;
+	// Only implementations that time their uploads fill in the stats, the others return false.
+	virtual bool GetUploadStats(YUVTextures* /*textures*/, UploadStats* /*stats*/) { return false; }
 };
 
 RenderAPI* CreateRenderAPI(UnityGfxRenderer apiType);
\ No newline at end of file
@@ -12,6 +12,26 @@
 #include <cstdint>
 #include <thread>
 #include "Logger.h"
+#include "PlaneCopy.h"
+
+struct YUVTextures_D3D11 : public YUVTextures
+{
+	static const unsigned int TEXTURE_NUM = 3;
+
+	unsigned int widthY;
+	unsigned int heightY;
+
+	unsigned int widthUV;
+	unsigned int heightUV;
+
+	YUVLayout layout;
+
+	ID3D11Texture2D* textures[TEXTURE_NUM];
+	ID3D11ShaderResourceView* shaderResourceView[TEXTURE_NUM];
+
+	YUVTextures_D3D11();
+	virtual ~YUVTextures_D3D11();
+};
 
 class RenderAPI_D3D11 : public RenderAPI
 {
@@ -23,27 +43,11 @@ public:
 
 	virtual bool GetUsesReverseZ() { return (int)device->GetFeatureLevel() >= (int)D3D_FEATURE_LEVEL_10_0; }
 
-	virtual void Create(int textureWidth, int textureHeight, void** ptry, void** ptru, void** ptrv);
-	virtual void UploadYUVFrame(unsigned char* ych, unsigned char* uch, unsigned char* vch);
-
-private:
-	void CreateResources();
-	void ReleaseResources();
+	virtual YUVTextures* Create(int textureWidth, int textureHeight, YUVLayout layout, void** ptry, void** ptru, void** ptrv);
+	virtual void UploadYUVFrame(YUVTextures* textures, unsigned char* ych, unsigned char* uch, unsigned char* vch, const int* linesize);
 
 private:
 	ID3D11Device* device;
-	static const unsigned int TEXTURE_NUM = 3;
-
-	unsigned int widthY;
-	unsigned int heightY;
-	unsigned int lengthY;
-
-	unsigned int widthUV;
-	unsigned int heightUV;
-	unsigned int lengthUV;
-
-	ID3D11Texture2D* textures[TEXTURE_NUM];
-	ID3D11ShaderResourceView* shaderResourceView[TEXTURE_NUM];
 };
 
 RenderAPI* CreateRenderAPI_D3D11()
@@ -51,32 +55,11 @@ RenderAPI* CreateRenderAPI_D3D11()
 	return new RenderAPI_D3D11();
 }
 
-RenderAPI_D3D11::RenderAPI_D3D11()
-	: device(NULL)
+YUVTextures_D3D11::YUVTextures_D3D11()
 {
-}
-
-void RenderAPI_D3D11::ProcessDeviceEvent(UnityGfxDeviceEventType type, IUnityInterfaces* interfaces)
-{
-	switch (type)
-	{
-		case kUnityGfxDeviceEventInitialize:
-		{
-			IUnityGraphicsD3D11* d3d = interfaces->Get<IUnityGraphicsD3D11>();
-			device = d3d->GetDevice();
-			CreateResources();
-			break;
-		}
-		case kUnityGfxDeviceEventShutdown:
-			ReleaseResources();
-			break;
-	}
-}
-
-void RenderAPI_D3D11::CreateResources()
-{
-	widthY = heightY = lengthY = 0;
-	widthUV = heightUV = lengthUV = 0;
+	widthY = heightY = 0;
+	widthUV = heightUV = 0;
+	layout = YUV_PLANES;
 
 	for (int i = 0; i < TEXTURE_NUM; i++)
 	{
@@ -85,11 +68,8 @@ void RenderAPI_D3D11::CreateResources()
 	}
 }
 
-void RenderAPI_D3D11::ReleaseResources()
+YUVTextures_D3D11::~YUVTextures_D3D11()
 {
-	widthY = heightY = lengthY = 0;
-	widthUV = heightUV = lengthUV = 0;
-
 	for (int i = 0; i < TEXTURE_NUM; i++)
 	{
 		if (textures[i] != NULL)
@@ -106,20 +86,48 @@ void RenderAPI_D3D11::ReleaseResources()
 	}
 }
 
-void RenderAPI_D3D11::Create(int textureWidth, int textureHeight, void** ptry, void** ptru, void** ptrv)
+RenderAPI_D3D11::RenderAPI_D3D11()
+	: device(NULL)
+{
+}
+
+//	The textures belong to the players, they release them when they are destroyed.
+void RenderAPI_D3D11::ProcessDeviceEvent(UnityGfxDeviceEventType type, IUnityInterfaces* interfaces)
+{
+	switch (type)
+	{
+		case kUnityGfxDeviceEventInitialize:
+		{
+			IUnityGraphicsD3D11* d3d = interfaces->Get<IUnityGraphicsD3D11>();
+			device = d3d->GetDevice();
+			break;
+		}
+		case kUnityGfxDeviceEventShutdown:
+			device = NULL;
+			break;
+	}
+}
+
+YUVTextures* RenderAPI_D3D11::Create(int textureWidth, int textureHeight, YUVLayout layout, void** ptry, void** ptru, void** ptrv)
 {
-	widthY = (unsigned int)(ceil((float)textureWidth / 64) * 64);
-	heightY = textureHeight;
-	lengthY = widthY * heightY;
+	if (device == NULL)
+	{
+		return NULL;
+	}
+
+	YUVTextures_D3D11* yuv = new YUVTextures_D3D11();
 
-	widthUV = widthY / 2;
-	heightUV = heightY / 2;
-	lengthUV = widthUV * heightUV;
+	yuv->widthY = textureWidth;
+	yuv->heightY = textureHeight;
+
+	yuv->widthUV = textureWidth / 2;
+	yuv->heightUV = textureHeight / 2;
+	yuv->layout = layout;
 
 	D3D11_TEXTURE2D_DESC textDesc;
 	ZeroMemory(&textDesc, sizeof(D3D11_TEXTURE2D_DESC));
 	textDesc.Width = textureWidth;
-	textDesc.Height = textureHeight;
+	textDesc.Height = layout == YUV_ATLAS ? textureHeight + textureHeight / 2 : textureHeight;
 	textDesc.MipLevels = textDesc.ArraySize = 1;
 	textDesc.Format = DXGI_FORMAT_A8_UNORM;
 	textDesc.SampleDesc.Count = 1;
@@ -134,114 +142,87 @@ void RenderAPI_D3D11::Create(int textureWidth, int textureHeight, void** ptry, v
 	shaderResourceViewDesc.Texture2D.MostDetailedMip = 0;
 	shaderResourceViewDesc.Texture2D.MipLevels = 1;
 
-	HRESULT result = device->CreateTexture2D(&textDesc, NULL, &textures[0]);
+	HRESULT result = device->CreateTexture2D(&textDesc, NULL, &yuv->textures[0]);
 	if (FAILED(result)) { LOG("Create texture Y fail. Error code: %x\n", result); }
 
-	result = device->CreateShaderResourceView(textures[0], &shaderResourceViewDesc, &shaderResourceView[0]);
+	result = device->CreateShaderResourceView(yuv->textures[0], &shaderResourceViewDesc, &yuv->shaderResourceView[0]);
 	if (FAILED(result)) { LOG("Create shader resource view Y fail. Error code: %x\n", result); }
 
+	if (layout == YUV_ATLAS)
+	{
+		*ptry = yuv->shaderResourceView[0];
+		*ptru = NULL;
+		*ptrv = NULL;
+		return yuv;
+	}
+
 	textDesc.Width = textureWidth / 2;
 	textDesc.Height = textureHeight / 2;
-	result = device->CreateTexture2D(&textDesc, NULL, &textures[1]);
+	result = device->CreateTexture2D(&textDesc, NULL, &yuv->textures[1]);
 	if (FAILED(result)) { LOG("Create texture U fail. Error code: %x\n", result); }
 
-	result = device->CreateShaderResourceView(textures[1], &shaderResourceViewDesc, &shaderResourceView[1]);
+	result = device->CreateShaderResourceView(yuv->textures[1], &shaderResourceViewDesc, &yuv->shaderResourceView[1]);
 	if (FAILED(result)) { LOG("Create shader resource view U fail. Error code: %x\n", result); }
 
-	result = device->CreateTexture2D(&textDesc, NULL, &textures[2]);
+	result = device->CreateTexture2D(&textDesc, NULL, &yuv->textures[2]);
 	if (FAILED(result)) { LOG("Create texture V fail. Error code: %x\n", result); }
 
-	result = device->CreateShaderResourceView(textures[2], &shaderResourceViewDesc, &shaderResourceView[2]);
+	result = device->CreateShaderResourceView(yuv->textures[2], &shaderResourceViewDesc, &yuv->shaderResourceView[2]);
 	if (FAILED(result)) { LOG("Create shader resource view V fail. %x\n", result); }
 
-	*ptry = shaderResourceView[0];
-	*ptru = shaderResourceView[1];
-	*ptrv = shaderResourceView[2];
+	*ptry = yuv->shaderResourceView[0];
+	*ptru = yuv->shaderResourceView[1];
+	*ptrv = yuv->shaderResourceView[2];
+
+	return yuv;
 }
 
-void RenderAPI_D3D11::UploadYUVFrame(unsigned char* ych, unsigned char* uch, unsigned char* vch)
+void RenderAPI_D3D11::UploadYUVFrame(YUVTextures* textures, unsigned char* ych, unsigned char* uch, unsigned char* vch, const int* linesize)
 {
-	if (device == NULL)
+	if (device == NULL || textures == NULL)
 	{
 		return;
 	}
 
+	YUVTextures_D3D11* yuv = static_cast<YUVTextures_D3D11*>(textures);
+
 	ID3D11DeviceContext* ctx = NULL;
 	device->GetImmediateContext(&ctx);
 
-	D3D11_MAPPED_SUBRESOURCE mappedResource[TEXTURE_NUM];
-	for (int i = 0; i < TEXTURE_NUM; i++)
+	if (yuv->layout == YUV_ATLAS)
 	{
-		ZeroMemory(&(mappedResource[i]), sizeof(D3D11_MAPPED_SUBRESOURCE));
-	}
-
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		ZeroMemory(&mappedResource, sizeof(D3D11_MAPPED_SUBRESOURCE));
 
-	ctx->Map(textures[0], 0, D3D11_MAP_WRITE_DISCARD, 0, &(mappedResource[0]));
-	UINT rowPitchY = mappedResource[0].RowPitch;
-	if (widthY == rowPitchY)
-	{
-		uint8_t* ptrMappedY = (uint8_t*)(mappedResource[0].pData);
-		memcpy(ptrMappedY, ych, lengthY);
-	}
-	else
-	{
-		uint8_t* ptrMappedY = (uint8_t*)(mappedResource[0].pData);
-		uint8_t* end = ych + lengthY;
-		while (ych != end)
+		//	A dynamic texture mapped with WRITE_DISCARD is write-combined memory, the copies stream into it.
+		HRESULT result = ctx->Map(yuv->textures[0], 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+		if (SUCCEEDED(result))
 		{
-			memcpy(ptrMappedY, ych, widthY);
-			ych += widthY;
-			ptrMappedY += rowPitchY;
+			CopyYUVAtlas((uint8_t*)mappedResource.pData, mappedResource.RowPitch, ych, uch, vch, linesize, yuv->widthY, yuv->heightY, true);
+			ctx->Unmap(yuv->textures[0], 0);
 		}
-	}
-	ctx->Unmap(textures[0], 0);
-
-
 
-	ctx->Map(textures[1], 0, D3D11_MAP_WRITE_DISCARD, 0, &(mappedResource[1]));
-	UINT rowPitchU = mappedResource[1].RowPitch;
-	if (widthUV == rowPitchU)
-	{
-		uint8_t* ptrMappedU = (uint8_t*)(mappedResource[1].pData);
-		memcpy(ptrMappedU, uch, lengthUV);
+		ctx->Release();
+		return;
 	}
-	else
+
+	unsigned char* planes[YUVTextures_D3D11::TEXTURE_NUM] = { ych, uch, vch };
+	for (int i = 0; i < YUVTextures_D3D11::TEXTURE_NUM; i++)
 	{
-		uint8_t* endU = uch + lengthUV;
-		uint8_t* ptrMappedU = (uint8_t*)(mappedResource[1].pData);
-		while (uch != endU)
-		{
-			memcpy(ptrMappedU, uch, widthUV);
+		unsigned int width = i == 0 ? yuv->widthY : yuv->widthUV;
+		unsigned int height = i == 0 ? yuv->heightY : yuv->heightUV;
 
-			uch += widthUV;
-			ptrMappedU += rowPitchU;
-		}
-	}
-	ctx->Unmap(textures[1], 0);
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		ZeroMemory(&mappedResource, sizeof(D3D11_MAPPED_SUBRESOURCE));
 
-	ctx->Map(textures[2], 0, D3D11_MAP_WRITE_DISCARD, 0, &(mappedResource[2]));
-	UINT rowPitchV = mappedResource[2].RowPitch;
-	if (widthUV == rowPitchV)
-	{
-		uint8_t* ptrMappedV = (uint8_t*)(mappedResource[2].pData);
-		memcpy(ptrMappedV, vch, lengthUV);
-	}
-	else
-	{
-		uint8_t* endV = vch + lengthUV;
-		uint8_t* ptrMappedV = (uint8_t*)(mappedResource[2].pData);
-		while (vch != endV)
+		HRESULT result = ctx->Map(yuv->textures[i], 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+		if (FAILED(result))
 		{
-			memcpy(ptrMappedV, vch, widthUV);
-			vch += widthUV;
-			ptrMappedV += rowPitchV;
+			continue;
 		}
-	}
-	ctx->Unmap(textures[2], 0);
 
-	for (int i = 0; i < TEXTURE_NUM; i++)
-	{
-		//ctx->Unmap(textures[i], 0);
+		CopyPlane((uint8_t*)mappedResource.pData, mappedResource.RowPitch, planes[i], linesize[i], width, height, true);
+		ctx->Unmap(yuv->textures[i], 0);
 	}
 
 	ctx->Release();
@@ -0,0 +1,184 @@
+#include "RenderAPI.h"
+#include "PlatformBase.h"
+
+// Software implementation of RenderAPI, for headless runs without a graphics device (kUnityGfxRendererNull).
+// The "textures" are plain CPU buffers, so the whole pipeline up to the upload can run on a machine without a GPU.
+
+#if SUPPORT_SOFTWARE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "PlaneCopy.h"
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+struct YUVTextures_Software : public YUVTextures
+{
+	static const unsigned int TEXTURE_NUM = 3;
+
+	unsigned int widthY;
+	unsigned int heightY;
+	unsigned int pitchY;
+
+	unsigned int widthUV;
+	unsigned int heightUV;
+	unsigned int pitchUV;
+
+	YUVLayout layout;
+
+	uint8_t* planes[TEXTURE_NUM];
+
+	//	Written by the render thread, read by whoever asks for the stats.
+	std::atomic<int>		uploadCount;
+	std::atomic<int64_t>	uploadBytes;
+	std::atomic<int64_t>	totalNanoseconds;
+	std::atomic<int64_t>	maxNanoseconds;
+	//	The Map and Unmap calls a GPU backend would have made for the same uploads.
+	std::atomic<int>		driverCalls;
+
+	YUVTextures_Software();
+	virtual ~YUVTextures_Software();
+};
+
+class RenderAPI_Software : public RenderAPI
+{
+public:
+	RenderAPI_Software() {}
+	virtual ~RenderAPI_Software() {}
+
+	virtual void ProcessDeviceEvent(UnityGfxDeviceEventType /*type*/, IUnityInterfaces* /*interfaces*/) {}
+
+	virtual bool GetUsesReverseZ() { return false; }
+
+	virtual YUVTextures* Create(int textureWidth, int textureHeight, YUVLayout layout, void** ptry, void** ptru, void** ptrv);
+	virtual void UploadYUVFrame(YUVTextures* textures, unsigned char* ych, unsigned char* uch, unsigned char* vch, const int* linesize);
+	virtual bool GetUploadStats(YUVTextures* textures, UploadStats* stats);
+};
+
+RenderAPI* CreateRenderAPI_Software()
+{
+	return new RenderAPI_Software();
+}
+
+YUVTextures_Software::YUVTextures_Software()
+{
+	widthY = heightY = pitchY = 0;
+	widthUV = heightUV = pitchUV = 0;
+	layout = YUV_PLANES;
+
+	for (unsigned int i = 0; i < TEXTURE_NUM; i++)
+	{
+		planes[i] = NULL;
+	}
+
+	uploadCount = 0;
+	uploadBytes = 0;
+	totalNanoseconds = 0;
+	maxNanoseconds = 0;
+	driverCalls = 0;
+}
+
+YUVTextures_Software::~YUVTextures_Software()
+{
+	for (unsigned int i = 0; i < TEXTURE_NUM; i++)
+	{
+		av_freep(&planes[i]);
+	}
+}
+
+//	Rows are padded to 64 bytes, like the pitch a GPU driver would pick.
+YUVTextures* RenderAPI_Software::Create(int textureWidth, int textureHeight, YUVLayout layout, void** ptry, void** ptru, void** ptrv)
+{
+	YUVTextures_Software* yuv = new YUVTextures_Software();
+
+	yuv->widthY = textureWidth;
+	yuv->heightY = textureHeight;
+	yuv->pitchY = (unsigned int)((textureWidth + 63) / 64 * 64);
+
+	yuv->widthUV = textureWidth / 2;
+	yuv->heightUV = textureHeight / 2;
+	yuv->pitchUV = yuv->pitchY / 2;
+	yuv->layout = layout;
+
+	//	av_malloc aligns for the widest SIMD loads FFmpeg was built for. The atlas is one plane with the chroma rows below the luma.
+	if (layout == YUV_ATLAS)
+	{
+		yuv->planes[0] = (uint8_t*)av_mallocz(yuv->pitchY * (yuv->heightY + yuv->heightUV));
+	}
+	else
+	{
+		yuv->planes[0] = (uint8_t*)av_mallocz(yuv->pitchY * yuv->heightY);
+		yuv->planes[1] = (uint8_t*)av_mallocz(yuv->pitchUV * yuv->heightUV);
+		yuv->planes[2] = (uint8_t*)av_mallocz(yuv->pitchUV * yuv->heightUV);
+	}
+
+	if (yuv->planes[0] == NULL || (layout == YUV_PLANES && (yuv->planes[1] == NULL || yuv->planes[2] == NULL)))
+	{
+		delete yuv;
+		return NULL;
+	}
+
+	*ptry = yuv->planes[0];
+	*ptru = yuv->planes[1];
+	*ptrv = yuv->planes[2];
+
+	return yuv;
+}
+
+void RenderAPI_Software::UploadYUVFrame(YUVTextures* textures, unsigned char* ych, unsigned char* uch, unsigned char* vch, const int* linesize)
+{
+	if (textures == NULL)
+	{
+		return;
+	}
+
+	YUVTextures_Software* yuv = static_cast<YUVTextures_Software*>(textures);
+
+	auto start = std::chrono::steady_clock::now();
+
+	if (yuv->layout == YUV_ATLAS)
+	{
+		CopyYUVAtlas(yuv->planes[0], yuv->pitchY, ych, uch, vch, linesize, yuv->widthY, yuv->heightY);
+	}
+	else
+	{
+		CopyPlane(yuv->planes[0], yuv->pitchY, ych, linesize[0], yuv->widthY, yuv->heightY);
+		CopyPlane(yuv->planes[1], yuv->pitchUV, uch, linesize[1], yuv->widthUV, yuv->heightUV);
+		CopyPlane(yuv->planes[2], yuv->pitchUV, vch, linesize[2], yuv->widthUV, yuv->heightUV);
+	}
+
+	int64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+	//	Only the render thread uploads, so plain loads and stores are enough for the maximum.
+	yuv->uploadCount++;
+	yuv->uploadBytes += (int64_t)yuv->widthY * yuv->heightY + 2 * (int64_t)yuv->widthUV * yuv->heightUV;
+	yuv->totalNanoseconds += nanoseconds;
+	yuv->driverCalls += yuv->layout == YUV_ATLAS ? 2 : 2 * YUVTextures_Software::TEXTURE_NUM;
+	if (nanoseconds > yuv->maxNanoseconds)
+	{
+		yuv->maxNanoseconds = nanoseconds;
+	}
+}
+
+bool RenderAPI_Software::GetUploadStats(YUVTextures* textures, UploadStats* stats)
+{
+	if (textures == NULL)
+	{
+		return false;
+	}
+
+	YUVTextures_Software* yuv = static_cast<YUVTextures_Software*>(textures);
+
+	stats->uploadCount = yuv->uploadCount;
+	stats->uploadBytes = yuv->uploadBytes;
+	stats->totalSeconds = (double)yuv->totalNanoseconds / 1000000000.0;
+	stats->maxSeconds = (double)yuv->maxNanoseconds / 1000000000.0;
+	stats->driverCalls = yuv->driverCalls;
+	return true;
+}
+
+#endif // #if SUPPORT_SOFTWARE
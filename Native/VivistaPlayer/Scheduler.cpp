@@ -0,0 +1,282 @@
+#include "Scheduler.h"
+#include "ThreadUtil.h"
+
+#include <algorithm>
+
+//	Index of the worker running on this thread, -1 on threads outside the pool.
+static thread_local int s_CurrentWorker = -1;
+
+//	Created by the first Get(), never deleted.
+static std::atomic<Scheduler*> s_Scheduler(NULL);
+static std::once_flag s_SchedulerOnce;
+
+//	Workers of the pool, 0 sizes it to the cores.
+static std::atomic<unsigned int> s_WorkerCount(0);
+
+Scheduler::Task::Task()
+{
+	//	Wake() does nothing until the task is started.
+	state = DONE;
+	priority = PRIORITY_NORMAL;
+	cpuNanoseconds = 0;
+}
+
+Scheduler::Task::~Task()
+{
+	Join();
+}
+
+//	Queues the first step. Does nothing while the task is still running, until a step returned STEP_DONE.
+void Scheduler::Task::Start(std::function<StepResult()> step)
+{
+	int done = DONE;
+	if (!state.compare_exchange_strong(done, QUEUED))
+	{
+		return;
+	}
+
+	this->step = step;
+	Scheduler::Get().Push(this, false);
+}
+
+//	Runs the task again if it is waiting. If it is in the middle of a step, it runs once more afterwards, so no wakeup is lost.
+void Scheduler::Task::Wake()
+{
+	int current = state;
+	while (true)
+	{
+		if (current == IDLE)
+		{
+			if (state.compare_exchange_weak(current, QUEUED))
+			{
+				Scheduler::Get().Push(this, false);
+				return;
+			}
+		}
+		else if (current == RUNNING)
+		{
+			if (state.compare_exchange_weak(current, RUNNING_WOKEN))
+			{
+				return;
+			}
+		}
+		else
+		{
+			return;
+		}
+	}
+}
+
+//	Waits until a step returned STEP_DONE. Whatever makes the step return that has to Wake() the task first.
+void Scheduler::Task::Join()
+{
+	std::unique_lock<std::mutex> lock(doneMutex);
+	doneCond.wait(lock, [this] { return state == DONE; });
+}
+
+//	Takes effect the next time the task is queued.
+void Scheduler::Task::SetPriority(Priority priority)
+{
+	this->priority = priority;
+}
+
+//	CPU time spent in the steps of this task, in seconds.
+double Scheduler::Task::GetCpuTime()
+{
+	return (double)cpuNanoseconds / 1000000000.0;
+}
+
+Scheduler& Scheduler::Get()
+{
+	std::call_once(s_SchedulerOnce, [] {
+		//	Leave one core for Unity's main and render threads, but keep enough workers that a stage stuck in I/O doesn't stall the rest.
+		unsigned int cores = std::thread::hardware_concurrency();
+		unsigned int workerCount = s_WorkerCount;
+		s_Scheduler = new Scheduler(workerCount > 0 ? workerCount : std::max(2u, cores > 1 ? cores - 1 : 1));
+	});
+	return *s_Scheduler;
+}
+
+/**
+ * Sets the number of workers instead of sizing the pool to the cores. Only
+ * takes effect before the first Get(), the pool is never resized.
+ */
+void Scheduler::SetWorkerCount(unsigned int count)
+{
+	s_WorkerCount = count;
+}
+
+/**
+ * Stops and joins the workers, if the pool was ever started. Every task has
+ * to be done by then, and it must not be called from a task. Tasks started
+ * afterwards never run.
+ */
+void Scheduler::Shutdown()
+{
+	Scheduler* scheduler = s_Scheduler;
+	if (scheduler == NULL)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(scheduler->sleepMutex);
+		scheduler->isStopping = true;
+		scheduler->sleepCond.notify_all();
+	}
+
+	for (size_t i = 0; i < scheduler->workers.size(); i++)
+	{
+		if (scheduler->workers[i]->thread.joinable())
+		{
+			scheduler->workers[i]->thread.join();
+		}
+	}
+}
+
+Scheduler::Scheduler(unsigned int workerCount)
+{
+	nextWorker = 0;
+	queuedCount = 0;
+	sleepingCount = 0;
+	isStopping = false;
+
+	for (unsigned int i = 0; i < workerCount; i++)
+	{
+		workers.push_back(std::unique_ptr<Worker>(new Worker()));
+	}
+
+	for (unsigned int i = 0; i < workerCount; i++)
+	{
+		workers[i]->thread = std::thread(&Scheduler::WorkerLoop, this, i);
+	}
+}
+
+/**
+ * Queues a task on the current worker, or spreads tasks from other threads
+ * over the workers. A task that was woken goes to the back, where its worker
+ * takes it next while its data is still in the cache. A task that just ran a
+ * step goes to the front, behind the other tasks of the same priority.
+ */
+void Scheduler::Push(Task* task, bool isRequeue)
+{
+	unsigned int index = s_CurrentWorker >= 0 ? (unsigned int)s_CurrentWorker : nextWorker++ % workers.size();
+	Worker* worker = workers[index].get();
+	int priority = task->priority;
+
+	{
+		std::lock_guard<std::mutex> lock(worker->mutex);
+		if (isRequeue)
+		{
+			worker->tasks[priority].push_front(task);
+		}
+		else
+		{
+			worker->tasks[priority].push_back(task);
+		}
+		queuedCount++;
+	}
+
+	//	Most pushes happen while every worker is busy, those don't need to touch the sleep mutex.
+	//	A worker that is about to sleep counts itself first and then checks queuedCount, so it can't miss this task.
+	if (sleepingCount > 0)
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		sleepCond.notify_one();
+	}
+}
+
+//	Own deque first, then the other workers, for one priority at a time.
+Scheduler::Task* Scheduler::Pop(unsigned int index)
+{
+	for (int priority = 0; priority < PRIORITY_COUNT; priority++)
+	{
+		for (size_t i = 0; i < workers.size(); i++)
+		{
+			Worker* worker = workers[(index + i) % workers.size()].get();
+			std::lock_guard<std::mutex> lock(worker->mutex);
+
+			std::deque<Task*>& tasks = worker->tasks[priority];
+			if (tasks.empty())
+			{
+				continue;
+			}
+
+			Task* task;
+			if (i == 0)
+			{
+				task = tasks.back();
+				tasks.pop_back();
+			}
+			else
+			{
+				task = tasks.front();
+				tasks.pop_front();
+			}
+			queuedCount--;
+			return task;
+		}
+	}
+
+	return NULL;
+}
+
+void Scheduler::Run(Task* task)
+{
+	task->state = Task::RUNNING;
+
+	double startTime = GetCurrentThreadCpuTime();
+	StepResult result = task->step();
+	task->cpuNanoseconds += (int64_t)((GetCurrentThreadCpuTime() - startTime) * 1000000000.0);
+
+	switch (result)
+	{
+		case STEP_AGAIN:
+			task->state = Task::QUEUED;
+			Push(task, true);
+			break;
+		case STEP_WAIT:
+		{
+			//	Woken during the step, the reason to wait may already be gone.
+			int running = Task::RUNNING;
+			if (!task->state.compare_exchange_strong(running, Task::IDLE))
+			{
+				task->state = Task::QUEUED;
+				Push(task, true);
+			}
+			break;
+		}
+		case STEP_DONE:
+		{
+			//	The owner may delete the task as soon as Join() returns, don't touch it after this.
+			std::lock_guard<std::mutex> lock(task->doneMutex);
+			task->state = Task::DONE;
+			task->doneCond.notify_all();
+			break;
+		}
+	}
+}
+
+void Scheduler::WorkerLoop(unsigned int index)
+{
+	s_CurrentWorker = (int)index;
+
+	while (true)
+	{
+		Task* task = Pop(index);
+		if (task != NULL)
+		{
+			Run(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepingCount++;
+		sleepCond.wait(lock, [this] { return isStopping || queuedCount > 0; });
+		sleepingCount--;
+		if (isStopping)
+		{
+			return;
+		}
+	}
+}
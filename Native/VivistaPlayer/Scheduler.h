@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * One pool of worker threads that runs the demux and decode stages of every
+ * player in the process, instead of every player starting its own threads.
+ *
+ * A stage is a Task that does a small step of work at a time, e.g. demux or
+ * decode one packet. When it can't continue it returns STEP_WAIT and is
+ * parked until something calls Wake() on it. A task never runs on two
+ * workers at once, so a stage can keep its state in plain members.
+ *
+ * Every worker has its own deque per priority. Woken tasks go to the deque of
+ * the thread that woke them, idle workers steal from the others. Workers
+ * always look through all deques of a higher priority before a lower one.
+ *
+ * The pool is never destroyed. Joining the workers from a static destructor
+ * can deadlock under the loader lock while the library is unloaded, so the
+ * plugin unload calls Shutdown() instead.
+ */
+class Scheduler
+{
+public:
+	enum Priority { PRIORITY_HIGH = 0, PRIORITY_NORMAL, PRIORITY_LOW, PRIORITY_COUNT };
+	enum StepResult { STEP_AGAIN, STEP_WAIT, STEP_DONE };
+
+	class Task
+	{
+	public:
+		Task();
+		~Task();
+
+		void Start(std::function<StepResult()> step);
+		void Wake();
+		void Join();
+		void SetPriority(Priority priority);
+		double GetCpuTime();
+
+	private:
+		friend class Scheduler;
+
+		enum State { IDLE, QUEUED, RUNNING, RUNNING_WOKEN, DONE };
+
+		std::function<StepResult()>	step;
+		std::atomic<int>			state;
+		std::atomic<int>			priority;
+		std::atomic<int64_t>		cpuNanoseconds;
+
+		std::mutex					doneMutex;
+		std::condition_variable		doneCond;
+	};
+
+	static Scheduler& Get();
+	static void SetWorkerCount(unsigned int count);
+	static void Shutdown();
+
+private:
+	struct Worker
+	{
+		std::mutex			mutex;
+		std::deque<Task*>	tasks[PRIORITY_COUNT];
+		std::thread			thread;
+	};
+
+	std::vector<std::unique_ptr<Worker>>	workers;
+	std::atomic<unsigned int>	nextWorker;
+	std::atomic<int>			queuedCount;
+	std::atomic<int>			sleepingCount;
+	bool						isStopping;
+
+	std::mutex					sleepMutex;
+	std::condition_variable		sleepCond;
+
+	Scheduler(unsigned int workerCount);
+
+	void Push(Task* task, bool isRequeue);
+	Task* Pop(unsigned int index);
+	void Run(Task* task);
+	void WorkerLoop(unsigned int index);
+};
@@ -0,0 +1,127 @@
+#include "ThreadUtil.h"
+#include "PlatformBase.h"
+
+#if UNITY_WIN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#if UNITY_LINUX || UNITY_ANDROID
+#include <sched.h>
+#endif
+
+double GetThreadCpuTime(std::thread& thread)
+{
+	if (!thread.joinable())
+	{
+		return 0;
+	}
+
+#if UNITY_WIN
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if (!GetThreadTimes((HANDLE)thread.native_handle(), &creationTime, &exitTime, &kernelTime, &userTime))
+	{
+		return 0;
+	}
+
+	//	FILETIME counts in 100 nanosecond intervals.
+	ULARGE_INTEGER kernel, user;
+	kernel.LowPart = kernelTime.dwLowDateTime;
+	kernel.HighPart = kernelTime.dwHighDateTime;
+	user.LowPart = userTime.dwLowDateTime;
+	user.HighPart = userTime.dwHighDateTime;
+	return (double)(kernel.QuadPart + user.QuadPart) / 10000000.0;
+#else
+	clockid_t clockId;
+	timespec time;
+	if (pthread_getcpuclockid(thread.native_handle(), &clockId) != 0 || clock_gettime(clockId, &time) != 0)
+	{
+		return 0;
+	}
+
+	return (double)time.tv_sec + (double)time.tv_nsec / 1000000000.0;
+#endif
+}
+
+double GetCurrentThreadCpuTime()
+{
+#if UNITY_WIN
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if (!GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime))
+	{
+		return 0;
+	}
+
+	ULARGE_INTEGER kernel, user;
+	kernel.LowPart = kernelTime.dwLowDateTime;
+	kernel.HighPart = kernelTime.dwHighDateTime;
+	user.LowPart = userTime.dwLowDateTime;
+	user.HighPart = userTime.dwHighDateTime;
+	return (double)(kernel.QuadPart + user.QuadPart) / 10000000.0;
+#else
+	timespec time;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+	{
+		return 0;
+	}
+
+	return (double)time.tv_sec + (double)time.tv_nsec / 1000000000.0;
+#endif
+}
+
+bool SetCurrentThreadAffinity(uint64_t mask, uint64_t* previousMask)
+{
+	if (mask == 0)
+	{
+		return false;
+	}
+
+#if UNITY_WIN
+	DWORD_PTR previous = SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask);
+	if (previous == 0)
+	{
+		return false;
+	}
+
+	if (previousMask != NULL)
+	{
+		*previousMask = previous;
+	}
+	return true;
+#elif UNITY_LINUX || UNITY_ANDROID
+	//	A pid of 0 means the calling thread.
+	cpu_set_t cpuSet;
+	if (previousMask != NULL)
+	{
+		CPU_ZERO(&cpuSet);
+		if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) != 0)
+		{
+			return false;
+		}
+
+		*previousMask = 0;
+		for (int i = 0; i < 64; i++)
+		{
+			if (CPU_ISSET(i, &cpuSet))
+			{
+				*previousMask |= (uint64_t)1 << i;
+			}
+		}
+	}
+
+	CPU_ZERO(&cpuSet);
+	for (int i = 0; i < 64; i++)
+	{
+		if (mask & ((uint64_t)1 << i))
+		{
+			CPU_SET(i, &cpuSet);
+		}
+	}
+	return sched_setaffinity(0, sizeof(cpuSet), &cpuSet) == 0;
+#else
+	(void)previousMask;
+	return false;
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#pragma once
+#include <thread>
+#include <stdint.h>
+
+// Small platform helpers for the threads the player owns.
+
+// Returns the CPU time in seconds the thread has consumed so far, or 0 if the thread is not running.
+double GetThreadCpuTime(std::thread& thread);
+
+// The same for the calling thread.
+double GetCurrentThreadCpuTime();
+
+// Pins the calling thread to the CPUs in the mask (bit n is CPU n). A mask of 0 leaves the thread alone.
+// Optionally returns the previous mask so it can be restored. Returns false where this is not supported.
+bool SetCurrentThreadAffinity(uint64_t mask, uint64_t* previousMask = NULL);
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "PlatformBase.h"
 #include "RenderAPI.h"
 #include "Manager.h"
+#include "FileCache.h"
 #include "Logger.h"
 
 #include <cassert>
@@ -10,6 +11,9 @@
 #include <string>
 #include <memory>
 #include <list>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
 
 using namespace std;
 
@@ -18,21 +22,109 @@ typedef struct VideoContext
 	string path;
 	thread initThread;
 	Manager* manager = NULL;
-	float progressTime = 0.0f;
+	//	Replaced by NativeCreateTexture while the render thread may be uploading, so both sides go through atomic_load/atomic_store.
+	//	Old textures are freed by whichever side lets go of them last.
+	shared_ptr<YUVTextures> textures;
+	YUVLayout textureLayout = YUV_PLANES;
 	float lastUpdateTime = -1.0f;
 	bool isContentReady = false;
+	int64_t bufferMaxBytes = 0;
+	float bufferMaxSeconds = 0.0f;
+	int lastSkippedFrames = 0;
+	int totalSkippedFrames = 0;
+
+	//	The render thread can drop the last reference, so everything slow already happened in stopPlayer.
+	~VideoContext()
+	{
+		delete manager;
+	}
 } VideoContext;
 
 typedef void(__stdcall* DebugCallback) (const char* str);
 DebugCallback DebugLogCallback;
 
-VideoContext* videoContext;
+// Every player lives in a slot of this table, its index is the id the API hands out.
+// The render thread looks players up on every event, so reading a slot doesn't take a lock. Only creating and destroying players do.
+static const int MAX_PLAYERS = 16;
+static shared_ptr<VideoContext> s_Players[MAX_PLAYERS];
+static mutex s_PlayersMutex;
+
+// Players NativeSwapPlayers took out of their slot. Each one is stopped on a thread of its own so the swap never waits for it,
+// plugin unload waits until all of them are gone. Guarded by s_PlayersMutex.
+static int s_RetiringPlayers = 0;
+static condition_variable s_RetiredCond;
+
+// Applied to every player created by NativeInitDecoder after NativeSetDecoderThreading
+static Decoder::ThreadingConfig s_ThreadingConfig = {};
+static bool s_FastOpen = false;
+static bool s_Preroll = false;
+static int s_AudioSampleRate = 0;
+static bool s_AudioAllChannels = false;
 
 static IUnityInterfaces* s_UnityInterfaces = NULL;
 static IUnityGraphics* s_Graphics = NULL;
 static RenderAPI* s_CurrentAPI = NULL;
 static UnityGfxRenderer s_DeviceType = kUnityGfxRendererNull;
 
+static bool getVideoContext(int id, shared_ptr<VideoContext>& videoCtx)
+{
+	if (id < 0 || id >= MAX_PLAYERS)
+	{
+		return false;
+	}
+
+	videoCtx = atomic_load(&s_Players[id]);
+	return videoCtx != NULL;
+}
+
+// Puts a new player in a free slot and starts opening path on a thread of its own. Call with s_PlayersMutex held.
+// Returns the slot, or -1 when all of them are taken.
+static int createPlayer(const char* path, bool isPreroll)
+{
+	int id = -1;
+	for (int i = 0; i < MAX_PLAYERS && id < 0; i++)
+	{
+		if (atomic_load(&s_Players[i]) == NULL)
+		{
+			id = i;
+		}
+	}
+
+	if (id < 0)
+	{
+		return -1;
+	}
+
+	shared_ptr<VideoContext> videoCtx = make_shared<VideoContext>();
+	videoCtx->manager = new Manager();
+	videoCtx->manager->SetThreadingConfig(s_ThreadingConfig);
+	videoCtx->manager->SetFastOpen(s_FastOpen);
+	videoCtx->manager->SetPreroll(isPreroll);
+	videoCtx->manager->SetAudioOutput(s_AudioSampleRate, s_AudioAllChannels);
+	videoCtx->path = string(path);
+	videoCtx->isContentReady = false;
+
+	//	stopPlayer joins this thread before the context is let go.
+	VideoContext* context = videoCtx.get();
+	context->initThread = thread([context]{
+		context->manager->Init(context->path.c_str());
+	});
+
+	atomic_store(&s_Players[id], videoCtx);
+
+	return id;
+}
+
+// The player has to be out of its slot already. The render thread may still hold a reference, whoever lets go last frees it.
+static void stopPlayer(const shared_ptr<VideoContext>& videoCtx)
+{
+	videoCtx->manager->Stop();
+	if (videoCtx->initThread.joinable())
+	{
+		videoCtx->initThread.join();
+	}
+}
+
 static void UNITY_INTERFACE_API OnGraphicsDeviceEvent(UnityGfxDeviceEventType eventType)
 {
 	// Create graphics API implementation upon initialization
@@ -71,7 +163,43 @@ extern "C" void	UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API UnityPluginLoad(IUnit
 extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API UnityPluginUnload()
 {
 	s_Graphics->UnregisterDeviceEventCallback(OnGraphicsDeviceEvent);
-	//NOTE(Simon): No further cleanup required; happens only on program exit
+
+	//	The threads stopping swapped out players run code from this library.
+	vector<shared_ptr<VideoContext>> players;
+	{
+		unique_lock<mutex> lock(s_PlayersMutex);
+		s_RetiredCond.wait(lock, []{ return s_RetiringPlayers == 0; });
+
+		for (int i = 0; i < MAX_PLAYERS; i++)
+		{
+			shared_ptr<VideoContext> videoCtx = atomic_load(&s_Players[i]);
+			if (videoCtx != NULL)
+			{
+				players.push_back(videoCtx);
+				atomic_store(&s_Players[i], shared_ptr<VideoContext>());
+			}
+		}
+	}
+
+	//	The scheduler workers are joined here rather than by a static destructor, which runs under the loader lock.
+	//	Their tasks belong to the players, so those are stopped first.
+	for (size_t i = 0; i < players.size(); i++)
+	{
+		stopPlayer(players[i]);
+	}
+
+	Scheduler::Shutdown();
+}
+
+// For hosts other than Unity that run without a GPU. Nothing sends them graphics device
+// events, so this sets up the renderer of kUnityGfxRendererNull, which uploads the frames into CPU memory.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeInitHeadless()
+{
+	if (s_CurrentAPI == NULL)
+	{
+		s_DeviceType = kUnityGfxRendererNull;
+		s_CurrentAPI = CreateRenderAPI(s_DeviceType);
+	}
 }
 
 extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API RegisterDebugLogCallback(DebugCallback callback)
@@ -96,24 +224,41 @@ static void UNITY_INTERFACE_API Update(int ID)
 	if (s_CurrentAPI == NULL)
 		return;
 
-	Manager* localManager = videoContext->manager;
-
-	if (localManager != NULL &&	localManager->GetPlayerState() >= Manager::PlayerState::INITIALIZED)
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(ID, videoCtx))
 	{
-		double videoDecCurTime = localManager->getVideoInfo().lastTime;
+		return;
+	}
 
-		if (videoDecCurTime <= videoContext->progressTime)
-		{
-			uint8_t* ptrY = NULL;
-			uint8_t* ptrU = NULL;
-			uint8_t* ptrV = NULL;
-			double curFrameTime = localManager->GetVideoFrame(&ptrY, &ptrU, &ptrV);
+	Manager* localManager = videoCtx->manager;
 
-			if (ptrY != NULL && curFrameTime != -1 && videoContext->lastUpdateTime != curFrameTime)
+	//	A prerolled player keeps its first frames until NativeStart, they are not due before.
+	if (localManager != NULL && localManager->IsStarted())
+	{
+		//	Frames are due by the native presentation clock. Before the first frame after a start or seek
+		//	there is no time yet, that frame is shown right away and starts the clock.
+		double presentationTime = localManager->GetPresentationTime();
+
+		//	When we render slower than the video, or after a hitch, several frames can be due at once.
+		//	Only the newest of them is worth uploading.
+		int skippedFrames = localManager->SkipVideoFrames(presentationTime);
+		videoCtx->lastSkippedFrames = skippedFrames;
+		videoCtx->totalSkippedFrames += skippedFrames;
+
+		uint8_t* ptrY = NULL;
+		uint8_t* ptrU = NULL;
+		uint8_t* ptrV = NULL;
+		int linesize[3] = {};
+		double curFrameTime = localManager->GetVideoFrame(&ptrY, &ptrU, &ptrV, linesize);
+
+		if (ptrY != NULL && curFrameTime != -1 && (presentationTime < 0 || curFrameTime <= presentationTime))
+		{
+			if (videoCtx->lastUpdateTime != curFrameTime)
 			{
-				s_CurrentAPI->UploadYUVFrame(ptrY, ptrU, ptrV);
-				videoContext->lastUpdateTime = (float)curFrameTime;
-				videoContext->isContentReady = true;
+				shared_ptr<YUVTextures> textures = atomic_load(&videoCtx->textures);
+				s_CurrentAPI->UploadYUVFrame(textures.get(), ptrY, ptrU, ptrV, linesize);
+				videoCtx->lastUpdateTime = (float)curFrameTime;
+				videoCtx->isContentReady = true;
 			}
 			localManager->FreeVideoFrame();
 		}
@@ -126,102 +271,370 @@ extern "C" UnityRenderingEvent UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetUpd
 	return Update;
 }
 
+// Returns -1 when all player slots are taken
 extern "C" int UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeInitDecoder(const char* path, int& id)
 {
-	videoContext = new VideoContext();
-	videoContext->manager = new Manager();
-	videoContext->path = string(path);
-	videoContext->isContentReady = false;
+	lock_guard<mutex> lock(s_PlayersMutex);
 
-	videoContext->initThread = thread([]{
-		videoContext->manager->Init(videoContext->path.c_str());
-	});
+	id = createPlayer(path, s_Preroll);
+	return id < 0 ? -1 : 0;
+}
 
+// Opens the next clip in the background while the current one keeps playing: it is probed and its first frames are
+// decoded on low priority, whatever NativeSetPreroll says. Poll NativeGetPlayerState(preloadId) for PREROLLED, create its
+// textures with NativeCreateTexture(preloadId) and promote it with NativeSwapPlayers. Returns -1 when all player slots are taken.
+extern "C" int UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativePreload(const char* path, int& preloadId)
+{
+	lock_guard<mutex> lock(s_PlayersMutex);
+
+	preloadId = createPlayer(path, true);
+	if (preloadId < 0)
+	{
+		return -1;
+	}
+
+	atomic_load(&s_Players[preloadId])->manager->SetPriority(Scheduler::PRIORITY_LOW);
 	return 0;
 }
 
-extern "C" int UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeGetPlayerState()
+// Moves the player in preloadId into the slot of id, so everything addressing id from now on reaches the preloaded clip.
+// The swap only exchanges two slots, the old player is stopped and freed on a thread of its own.
+// Call NativeStart(id) afterwards. Returns false when there is no player in preloadId.
+extern "C" bool UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeSwapPlayers(int id, int preloadId)
 {
-	if (videoContext->manager == NULL)
+	if (id < 0 || id >= MAX_PLAYERS || id == preloadId)
+	{
+		return false;
+	}
+
+	shared_ptr<VideoContext> oldCtx;
+	{
+		lock_guard<mutex> lock(s_PlayersMutex);
+		shared_ptr<VideoContext> newCtx;
+		if (!getVideoContext(preloadId, newCtx))
+		{
+			return false;
+		}
+
+		oldCtx = atomic_load(&s_Players[id]);
+		atomic_store(&s_Players[id], newCtx);
+		atomic_store(&s_Players[preloadId], shared_ptr<VideoContext>());
+
+		if (oldCtx == NULL)
+		{
+			return true;
+		}
+		s_RetiringPlayers++;
+	}
+
+	thread([videoCtx = move(oldCtx)]() mutable {
+		stopPlayer(videoCtx);
+		videoCtx.reset();
+
+		lock_guard<mutex> lock(s_PlayersMutex);
+		s_RetiringPlayers--;
+		s_RetiredCond.notify_all();
+	}).detach();
+
+	return true;
+}
+
+extern "C" int UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeGetPlayerState(int id)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL)
 	{
 		return -1;
 	}
 
-	return videoContext->manager->GetPlayerState();
+	return videoCtx->manager->GetPlayerState();
 }
 
-extern "C" bool UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeCreateTexture(void** texY, void** texU, void** texV)
+// Can be called again later, e.g. for a new layout. The render thread switches to the new textures with its next upload.
+extern "C" bool UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeCreateTexture(int id, void** texY, void** texU, void** texV)
 {
-	if (texY == nullptr || texU == nullptr || texV == nullptr)
+	if (texY == nullptr || texU == nullptr || texV == nullptr || s_CurrentAPI == NULL)
 	{
 		return false;
 	}
 
-	unsigned int width = videoContext->manager->getVideoInfo().width;
-	unsigned int height = videoContext->manager->getVideoInfo().height;
-	s_CurrentAPI->Create(width, height, texY, texU, texV);
-	return true;
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx))
+	{
+		return false;
+	}
+
+	unsigned int width = videoCtx->manager->getVideoInfo().width;
+	unsigned int height = videoCtx->manager->getVideoInfo().height;
+	shared_ptr<YUVTextures> textures(s_CurrentAPI->Create(width, height, videoCtx->textureLayout, texY, texU, texV));
+	atomic_store(&videoCtx->textures, textures);
+	return textures != NULL;
 }
 
-extern "C" bool UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeStart()
+// 0 creates a texture per plane. 1 creates one texture with Y on top and U and V side by side below it, which is uploaded
+// in one go; only texY is returned then. Takes effect at the next NativeCreateTexture.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeSetTextureLayout(int id, int layout)
 {
-	if (videoContext->manager == NULL)
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || layout < YUV_PLANES || layout > YUV_ATLAS)
+	{
+		return;
+	}
+
+	videoCtx->textureLayout = (YUVLayout)layout;
+}
+
+extern "C" bool UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeStart(int id)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL)
 	{
 		return false;
 	}
 
-	if (videoContext->initThread.joinable())
+	if (videoCtx->initThread.joinable())
 	{
-		videoContext->initThread.join();
+		videoCtx->initThread.join();
 	}
 
-	Manager* localManager = videoContext->manager;
-	if (localManager->GetPlayerState() >= Manager::PlayerState::INITIALIZED)
+	Manager* localManager = videoCtx->manager;
+	if (localManager->IsOpened())
 	{
+		localManager->SetBufferLimits(videoCtx->bufferMaxBytes, videoCtx->bufferMaxSeconds);
 		localManager->Start();
 	}
 
 	if (!localManager->getVideoInfo().isEnabled)
 	{
-		videoContext->isContentReady = true;
+		videoCtx->isContentReady = true;
 	}
 
 	return true;
 }
 
-extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeDestroy()
+// threadType: 0 codec default, 1 frame threading, 2 slice threading. Thread counts of 0 size the codec thread pools automatically.
+// Affinities are CPU bit masks for the codec threads, 0 leaves them unpinned. Demuxing runs on the shared scheduler, which is never pinned.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeSetDecoderThreading(int threadType, int videoThreadCount, int audioThreadCount,
+	uint64_t videoAffinity, uint64_t audioAffinity)
+{
+	s_ThreadingConfig.videoThreadType = threadType;
+	s_ThreadingConfig.videoThreadCount = videoThreadCount;
+	s_ThreadingConfig.audioThreadCount = audioThreadCount;
+	s_ThreadingConfig.videoAffinity = videoAffinity;
+	s_ThreadingConfig.audioAffinity = audioAffinity;
+}
+
+// Skips stream probing for players created after this call, when the container header or the cache is enough
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeSetFastOpen(bool isEnabled)
+{
+	s_FastOpen = isEnabled;
+}
+
+// Players created after this call decode their first frames during init and report PREROLLED instead of INITIALIZED
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeSetPreroll(bool isEnabled)
 {
-	videoContext->manager->Stop();
-	if (videoContext->initThread.joinable())
+	s_Preroll = isEnabled;
+}
+
+// Where per-video cache files such as keyframe indices are kept. By default they are written next to the video.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeSetCacheDirectory(const char* directory)
+{
+	FileCache::SetDirectory(directory);
+}
+
+// Caps the decoded frames that are buffered ahead, in bytes and in seconds of media. Values <= 0 keep the default.
+// Takes effect at the next NativeStart.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeSetBufferLimits(int id, int64_t maxBytes, float maxSeconds)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx))
+	{
+		return;
+	}
+
+	videoCtx->bufferMaxBytes = maxBytes;
+	videoCtx->bufferMaxSeconds = maxSeconds;
+}
+
+// 0 high, 1 normal, 2 low. The decoding of every player shares one pool of threads, players with a higher priority go first when it is busy.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeSetPriority(int id, int priority)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL)
+	{
+		return;
+	}
+
+	priority = max((int)Scheduler::PRIORITY_HIGH, min(priority, (int)Scheduler::PRIORITY_LOW));
+	videoCtx->manager->SetPriority((Scheduler::Priority)priority);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeDestroy(int id)
+{
+	shared_ptr<VideoContext> videoCtx;
 	{
-		videoContext->initThread.join();
+		lock_guard<mutex> lock(s_PlayersMutex);
+		if (!getVideoContext(id, videoCtx))
+		{
+			return;
+		}
+
+		atomic_store(&s_Players[id], shared_ptr<VideoContext>());
 	}
 
-	videoContext->manager = NULL;
-	videoContext->path.clear();
-	videoContext->progressTime = 0.0f;
-	videoContext->lastUpdateTime = 0.0f;
-	videoContext->isContentReady = false;
+	stopPlayer(videoCtx);
 }
 
 extern "C" bool UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeIsEOF(int id)
 {
-	if (videoContext->manager == NULL)
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL)
 	{
 		return true;
 	}
 
-	return videoContext->manager->GetPlayerState() == Manager::PlayerState::PLAY_EOF;
+	return videoCtx->manager->GetPlayerState() == Manager::PlayerState::PLAY_EOF;
 }
 
-extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetTimeFromUnity(float time)
+// Which clock the video and audio follow: 0 audio, 1 video, 2 external. Audio falls back to the external clock
+// while there is no audio or nothing pulls it, video falls back to audio when there is no video.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeSetSyncMaster(int id, int master)
 {
-	videoContext->progressTime = time;
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL || master < Decoder::SYNC_AUDIO || master > Decoder::SYNC_EXTERNAL)
+	{
+		return;
+	}
+
+	videoCtx->manager->SetSyncMaster((Decoder::SyncMaster)master);
 }
 
-extern "C" Decoder::VideoInfo UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeGetVideoInfo()
+// 1 is normal speed, the native side clamps it to 0.25 to 4. Audio is time-stretched so its pitch stays the same.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeSetPlaybackSpeed(int id, float speed)
 {
-	return videoContext->manager->getVideoInfo();
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL)
+	{
+		return;
+	}
+
+	videoCtx->manager->SetPlaybackSpeed(speed);
+}
+
+// Loops without a stall: the next iteration is demuxed and decoded while the end of the previous one is still shown.
+// Every iteration after the first starts at the keyframe at or before loopStart. The presentation time keeps counting
+// up over the iterations. Has to be set before the end of the video is demuxed, i.e. usually right after init.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeSetLoop(int id, bool isEnabled, float loopStart)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL)
+	{
+		return;
+	}
+
+	videoCtx->manager->SetLoop(isEnabled, loopStart);
+}
+
+// The playback position in seconds, -1 until the first frame after a start or seek is on screen
+extern "C" double UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeGetPresentationTime(int id)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL)
+	{
+		return -1;
+	}
+
+	return videoCtx->manager->GetPresentationTime();
+}
+
+extern "C" Decoder::VideoInfo UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeGetVideoInfo(int id)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL)
+	{
+		return Decoder::VideoInfo();
+	}
+
+	return videoCtx->manager->getVideoInfo();
+}
+
+// Fraction of one core used by the decoding threads since the previous call
+extern "C" float UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeGetDecodeCpuUsage(int id)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL)
+	{
+		return 0.0f;
+	}
+
+	return videoCtx->manager->GetDecodeCpuUsage();
+}
+
+extern "C" float UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeGetAllocationsPerSecond(int id)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL)
+	{
+		return 0.0f;
+	}
+
+	return videoCtx->manager->GetAllocationsPerSecond();
+}
+
+// Frames dropped because they were late, and frames the codec skipped to catch up
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeGetDroppedFrames(int id, int& droppedFrames, int& skippedFrames)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL)
+	{
+		droppedFrames = 0;
+		skippedFrames = 0;
+		return;
+	}
+
+	videoCtx->manager->GetDroppedFrames(droppedFrames, skippedFrames);
+}
+
+// Frames that were not 8 bit yuv420p at the size of the video and had to be converted on the decoder task,
+// e.g. 10 bit, 4:2:2 or NV12 output. The time is in seconds, for all of them and for the last one.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeGetConvertStats(int id, int& convertedFrames, double& totalSeconds, double& lastSeconds)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL)
+	{
+		convertedFrames = 0;
+		totalSeconds = lastSeconds = 0;
+		return;
+	}
+
+	videoCtx->manager->GetConvertStats(convertedFrames, totalSeconds, lastSeconds);
+}
+
+// Frames the render callback skipped over during the last tick, and in total
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeGetRenderSkippedFrames(int id, int& lastTick, int& total)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx))
+	{
+		lastTick = total = 0;
+		return;
+	}
+
+	lastTick = videoCtx->lastSkippedFrames;
+	total = videoCtx->totalSkippedFrames;
+}
+
+// Seconds from NativeInitDecoder until INITIALIZED and until the first frame, and from NativeStart until that frame. -1 until reached
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeGetStartupTimes(int id, float& initSeconds, float& firstFrameSeconds, float& startToFirstFrameSeconds)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL)
+	{
+		initSeconds = firstFrameSeconds = startToFirstFrameSeconds = -1.0f;
+		return;
+	}
+
+	videoCtx->manager->GetStartupTimes(initSeconds, firstFrameSeconds, startToFirstFrameSeconds);
 }
 
 #pragma region Video
@@ -319,51 +732,121 @@ extern "C" Decoder::VideoInfo UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeG
 //	videoCtx->manager->EnableAudio(isEnabled);
 //}
 
-// TODO audiochannels
+// Players created after this call resample their audio to this rate, 0 keeps the rate of the file.
+// Audio is downmixed to stereo unless keepAllChannels is set, e.g. for ambisonics.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeSetAudioOutput(int sampleRate, bool keepAllChannels)
+{
+	s_AudioSampleRate = sampleRate;
+	s_AudioAllChannels = keepAllChannels;
+}
+
+// Called from OnAudioFilterRead. Fills samples with frameCount interleaved frames of the given channel count
+// and returns how many of them came from the video, the rest is silence.
+extern "C" int UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeGetAudioSamples(int id, float* samples, int frameCount, int channels)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL)
+	{
+		if (samples != NULL && frameCount > 0 && channels > 0)
+		{
+			memset(samples, 0, (size_t)frameCount * channels * sizeof(float));
+		}
+		return 0;
+	}
+
+	return videoCtx->manager->GetAudioSamples(samples, frameCount, channels);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeGetAudioStats(int id, int& underruns, int& overruns)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL)
+	{
+		underruns = overruns = 0;
+		return;
+	}
 
-// TODO audioformat
+	videoCtx->manager->GetAudioStats(underruns, overruns);
+}
 
-// TODO audiodata
+// Cost of the texture uploads of a player so far. Only the software renderer of headless runs measures it, returns false otherwise.
+extern "C" bool UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeGetUploadStats(int id, int& uploadCount, int64_t& uploadBytes, double& totalSeconds, double& maxSeconds)
+{
+	uploadCount = 0;
+	uploadBytes = 0;
+	totalSeconds = maxSeconds = 0;
 
-// free audio
+	shared_ptr<VideoContext> videoCtx;
+	if (s_CurrentAPI == NULL || !getVideoContext(id, videoCtx))
+	{
+		return false;
+	}
+
+	UploadStats stats;
+	shared_ptr<YUVTextures> textures = atomic_load(&videoCtx->textures);
+	if (!s_CurrentAPI->GetUploadStats(textures.get(), &stats))
+	{
+		return false;
+	}
+
+	uploadCount = stats.uploadCount;
+	uploadBytes = stats.uploadBytes;
+	totalSeconds = stats.totalSeconds;
+	maxSeconds = stats.maxSeconds;
+	return true;
+}
 
 #pragma endregion
 
 #pragma region Seeking
 
-//extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API Seek(int id, float seconds)
-//{
-//	shared_ptr<VideoContext> videoCtx;
-//	if (!getVideoContext(id, videoCtx))
-//	{ 
-//		return;
-//	}
-//
-//	if (videoCtx->manager->GetPlayerState() < Manager::PlayerState::INITIALIZED)
-//	{
-//		return;
-//	}
-//
-//	videoCtx->manager->Seek(seconds);
-//
-//	if (!videoCtx->manager->getVideoInfo().isEnabled)
-//	{
-//		videoCtx->isContentReady = true;
-//	}
-//	else 
-//{
-//		videoCtx->isContentReady = false;
-//	}
-//}
-//
-//extern "C" bool UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API IsSeekOver(int id) {
-//	shared_ptr<VideoContext> videoCtx;
-//	if (!getVideoContext(id, videoCtx))
-//	{ 
-//		return false;
-//	}
-//
-//	return !(videoCtx->manager->GetPlayerState() == Manager::PlayerState::SEEK);
-//}
+// Can be called every frame while scrubbing, only the newest target is decoded
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeSeek(int id, float seconds)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL || !videoCtx->manager->IsOpened())
+	{
+		return;
+	}
+
+	//	Before NativeStart only the target is kept, also for a prerolled player. The start begins with the seek.
+	videoCtx->manager->Seek(seconds);
+}
+
+extern "C" bool UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeIsSeekOver(int id)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL)
+	{
+		return false;
+	}
+
+	return videoCtx->manager->GetPlayerState() != Manager::PlayerState::SEEK;
+}
+
+// The newest seek whose target frame is ready
+extern "C" int UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeGetSeekGeneration(int id)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL)
+	{
+		return 0;
+	}
+
+	return videoCtx->manager->GetSeekGeneration();
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API NativeGetSeekStats(int id, int& requested, int& coalesced, int& completed, float& lastSettleTime)
+{
+	shared_ptr<VideoContext> videoCtx;
+	if (!getVideoContext(id, videoCtx) || videoCtx->manager == NULL)
+	{
+		requested = coalesced = completed = 0;
+		lastSettleTime = 0.0f;
+		return;
+	}
+
+	videoCtx->manager->GetSeekStats(requested, coalesced, completed, lastSettleTime);
+}
 
 #pragma endregion
\ No newline at end of file
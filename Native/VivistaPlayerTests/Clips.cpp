@@ -0,0 +1,192 @@
+#include "Tests.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+}
+
+static void WritePackets(AVFormatContext* output, AVCodecContext* encoder, AVStream* stream, AVPacket* packet)
+{
+	while (avcodec_receive_packet(encoder, packet) == 0)
+	{
+		av_packet_rescale_ts(packet, encoder->time_base, stream->time_base);
+		packet->stream_index = stream->index;
+		av_interleaved_write_frame(output, packet);
+	}
+}
+
+//	x264 and x265 decide on their own where B-frames go. Fixed runs make every GOP as B-frame heavy as allowed.
+static void SetEncoderOptions(AVCodecContext* encoder)
+{
+	if (strcmp(encoder->codec->name, "libx264") == 0)
+	{
+		av_opt_set(encoder->priv_data, "preset", "veryfast", 0);
+		av_opt_set(encoder->priv_data, "x264-params", "b-adapt=0", 0);
+	}
+	else if (strcmp(encoder->codec->name, "libx265") == 0)
+	{
+		av_opt_set(encoder->priv_data, "preset", "veryfast", 0);
+		av_opt_set(encoder->priv_data, "x265-params", "b-adapt=0:log-level=error", 0);
+	}
+}
+
+// Audio of the clips: a 440 Hz tone in 16-bit stereo PCM.
+static const int AUDIO_SAMPLE_RATE = 48000;
+static const int AUDIO_FRAME_SAMPLES = 1024;
+static const double PI = 3.14159265358979323846;
+
+static AVCodecContext* OpenAudioEncoder(AVFormatContext* output, AVStream* stream)
+{
+	AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_PCM_S16LE);
+	AVCodecContext* encoder = codec != NULL ? avcodec_alloc_context3(codec) : NULL;
+	if (encoder == NULL)
+	{
+		return NULL;
+	}
+
+	encoder->sample_fmt = AV_SAMPLE_FMT_S16;
+	encoder->sample_rate = AUDIO_SAMPLE_RATE;
+	encoder->channel_layout = AV_CH_LAYOUT_STEREO;
+	encoder->channels = 2;
+	encoder->time_base = { 1, AUDIO_SAMPLE_RATE };
+	if (output->oformat->flags & AVFMT_GLOBALHEADER)
+	{
+		encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+	}
+
+	if (avcodec_open2(encoder, codec, NULL) < 0 || avcodec_parameters_from_context(stream->codecpar, encoder) < 0)
+	{
+		avcodec_free_context(&encoder);
+		return NULL;
+	}
+
+	stream->time_base = encoder->time_base;
+	return encoder;
+}
+
+//	Encodes the tone from the samples written so far up to the given sample.
+static void WriteAudio(AVFormatContext* output, AVCodecContext* encoder, AVStream* stream, AVPacket* packet,
+	int64_t& writtenSamples, int64_t endSample)
+{
+	AVFrame* frame = av_frame_alloc();
+	while (frame != NULL && writtenSamples < endSample)
+	{
+		frame->format = encoder->sample_fmt;
+		frame->channel_layout = encoder->channel_layout;
+		frame->sample_rate = encoder->sample_rate;
+		frame->nb_samples = (int)std::min<int64_t>(AUDIO_FRAME_SAMPLES, endSample - writtenSamples);
+		if (av_frame_get_buffer(frame, 0) < 0)
+		{
+			break;
+		}
+
+		int16_t* samples = (int16_t*)frame->data[0];
+		for (int i = 0; i < frame->nb_samples; i++)
+		{
+			double phase = 2 * PI * 440 * (writtenSamples + i) / AUDIO_SAMPLE_RATE;
+			samples[2 * i] = samples[2 * i + 1] = (int16_t)(8000 * sin(phase));
+		}
+		frame->pts = writtenSamples;
+		writtenSamples += frame->nb_samples;
+
+		avcodec_send_frame(encoder, frame);
+		WritePackets(output, encoder, stream, packet);
+		av_frame_unref(frame);
+	}
+	av_frame_free(&frame);
+}
+
+bool WriteClip(const char* path, const ClipFormat& format)
+{
+	AVFormatContext* output = NULL;
+	if (avformat_alloc_output_context2(&output, NULL, NULL, path) < 0)
+	{
+		return false;
+	}
+
+	AVCodec* codec = avcodec_find_encoder_by_name(format.encoder);
+	AVStream* stream = avformat_new_stream(output, NULL);
+	AVCodecContext* encoder = codec != NULL ? avcodec_alloc_context3(codec) : NULL;
+	AVStream* audioStream = format.hasAudio ? avformat_new_stream(output, NULL) : NULL;
+	AVCodecContext* audioEncoder = audioStream != NULL ? OpenAudioEncoder(output, audioStream) : NULL;
+	AVFrame* frame = av_frame_alloc();
+	AVPacket* packet = av_packet_alloc();
+	bool isWritten = false;
+
+	if (stream != NULL && encoder != NULL && frame != NULL && packet != NULL && (!format.hasAudio || audioEncoder != NULL))
+	{
+		encoder->width = format.width;
+		encoder->height = format.height;
+		encoder->pix_fmt = AV_PIX_FMT_YUV420P;
+		encoder->time_base = { 1, format.fps };
+		encoder->framerate = { format.fps, 1 };
+		encoder->gop_size = format.gop;
+		encoder->max_b_frames = format.maxBFrames;
+		if (output->oformat->flags & AVFMT_GLOBALHEADER)
+		{
+			encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+		}
+		SetEncoderOptions(encoder);
+
+		frame->format = encoder->pix_fmt;
+		frame->width = format.width;
+		frame->height = format.height;
+
+		if (avcodec_open2(encoder, codec, NULL) >= 0
+			&& avcodec_parameters_from_context(stream->codecpar, encoder) >= 0
+			&& av_frame_get_buffer(frame, 32) >= 0
+			&& avio_open(&output->pb, path, AVIO_FLAG_WRITE) >= 0)
+		{
+			stream->time_base = encoder->time_base;
+			if (avformat_write_header(output, NULL) >= 0)
+			{
+				int64_t audioSamples = 0;
+				for (int i = 0; i < format.frames; i++)
+				{
+					av_frame_make_writable(frame);
+					for (int y = 0; y < format.height; y++)
+					{
+						memset(frame->data[0] + y * frame->linesize[0], (i * 5 + y) & 0xFF, format.width);
+					}
+					for (int y = 0; y < format.height / 2; y++)
+					{
+						memset(frame->data[1] + y * frame->linesize[1], 128, format.width / 2);
+						memset(frame->data[2] + y * frame->linesize[2], 128, format.width / 2);
+					}
+					frame->pts = i;
+
+					avcodec_send_frame(encoder, frame);
+					WritePackets(output, encoder, stream, packet);
+
+					if (audioEncoder != NULL)
+					{
+						WriteAudio(output, audioEncoder, audioStream, packet, audioSamples,
+							(int64_t)(i + 1) * AUDIO_SAMPLE_RATE / format.fps);
+					}
+				}
+
+				avcodec_send_frame(encoder, NULL);
+				WritePackets(output, encoder, stream, packet);
+				if (audioEncoder != NULL)
+				{
+					avcodec_send_frame(audioEncoder, NULL);
+					WritePackets(output, audioEncoder, audioStream, packet);
+				}
+				isWritten = av_write_trailer(output) >= 0;
+			}
+			avio_closep(&output->pb);
+		}
+	}
+
+	av_packet_free(&packet);
+	av_frame_free(&frame);
+	avcodec_free_context(&encoder);
+	avcodec_free_context(&audioEncoder);
+	avformat_free_context(output);
+	return isWritten;
+}
@@ -0,0 +1,54 @@
+#include "Tests.h"
+
+#include <atomic>
+#include <thread>
+
+#include "Clock.h"
+
+void TestClock()
+{
+	Clock clock;
+	CHECK(clock.Get(0, 0.0) == -1);
+
+	clock.Set(10.0, 1, 100.0);
+	CHECK(clock.Get(1, 101.0) == 11.0);
+	CHECK(clock.Get(1, 102.5) == 12.5);
+	//	Set before the seek with serial 2, so it says nothing about the new position.
+	CHECK(clock.Get(2, 101.0) == -1);
+
+	//	A new speed goes on from the current reading.
+	clock.SetSpeed(2.0, 102.0);
+	CHECK(clock.Get(1, 102.0) == 12.0);
+	CHECK(clock.Get(1, 103.0) == 14.0);
+	CHECK(clock.GetSpeed() == 2.0);
+
+	//	The speed stays when the clock is set again after a seek.
+	clock.Set(40.0, 2, 104.0);
+	CHECK(clock.Get(2, 105.0) == 42.0);
+	CHECK(clock.Get(1, 105.0) == -1);
+
+	//	The writer keeps the pts equal to the time it was set at. At speed 1 every consistent reading at time t
+	//	is t, a pts and time that were torn apart by a concurrent Set() are off by a whole step.
+	Clock shared;
+	shared.Set(0.0, 1, 0.0);
+	std::atomic<bool> isDone(false);
+	std::thread writer([&shared, &isDone] {
+		for (int i = 1; i <= 200000; i++)
+		{
+			shared.Set((double)i, 1, (double)i);
+		}
+		isDone = true;
+	});
+
+	const double readTime = 1000000.0;
+	int tornReads = 0;
+	while (!isDone)
+	{
+		if (shared.Get(1, readTime) != readTime)
+		{
+			tornReads++;
+		}
+	}
+	writer.join();
+	CHECK(tornReads == 0);
+}
@@ -0,0 +1,183 @@
+#include "Tests.h"
+
+#include <chrono>
+#include <string.h>
+#include <vector>
+
+#include "PlaneCopy.h"
+
+static const uint8_t PADDING = 0xEE;
+
+static uint8_t SourceByte(int x, int y)
+{
+	return (uint8_t)(x * 7 + y * 13 + 1);
+}
+
+//	Copies a width x height plane between the given pitches, into a destination that starts at dstOffset from
+//	an aligned address, and checks every byte of the destination, padding included.
+static void CheckCopy(int width, int height, int srcPitch, int dstPitch, int dstOffset, bool isWriteCombined)
+{
+	std::vector<uint8_t> src((size_t)srcPitch * height);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < srcPitch; x++)
+		{
+			src[(size_t)y * srcPitch + x] = x < width ? SourceByte(x, y) : 0;
+		}
+	}
+
+	std::vector<uint8_t> dst((size_t)dstPitch * height + dstOffset + 64, PADDING);
+	uint8_t* start = dst.data() + dstOffset;
+	CopyPlane(start, dstPitch, src.data(), srcPitch, width, height, isWriteCombined);
+
+	int mismatches = 0;
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < dstPitch; x++)
+		{
+			uint8_t expected = x < width ? SourceByte(x, y) : PADDING;
+			if (start[(size_t)y * dstPitch + x] != expected)
+			{
+				mismatches++;
+			}
+		}
+	}
+	for (int i = 0; i < dstOffset; i++)
+	{
+		mismatches += dst[i] != PADDING;
+	}
+	CHECK(mismatches == 0);
+}
+
+void TestCopyPlane()
+{
+	for (int isWriteCombined = 0; isWriteCombined < 2; isWriteCombined++)
+	{
+		//	Rows of a decoder frame are padded, so are the rows of a texture, each by its own amount.
+		CheckCopy(100, 7, 128, 112, 0, isWriteCombined != 0);
+		//	Wide enough for the streaming stores, with an unaligned destination and a tail.
+		CheckCopy(1000, 5, 1024, 1040, 3, isWriteCombined != 0);
+		CheckCopy(1917, 3, 1920, 1984, 17, isWriteCombined != 0);
+		//	Without padding the plane is copied as one long row.
+		CheckCopy(300, 9, 300, 300, 5, isWriteCombined != 0);
+	}
+}
+
+void TestYUVAtlas()
+{
+	const int width = 8;
+	const int height = 4;
+	const int dstPitch = 16;
+	const int srcPitch[3] = { 12, 6, 8 };
+
+	std::vector<uint8_t> y(srcPitch[0] * height, 0);
+	std::vector<uint8_t> u(srcPitch[1] * height / 2, 0);
+	std::vector<uint8_t> v(srcPitch[2] * height / 2, 0);
+	for (int row = 0; row < height; row++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			y[row * srcPitch[0] + x] = (uint8_t)(row * width + x);
+		}
+	}
+	for (int row = 0; row < height / 2; row++)
+	{
+		for (int x = 0; x < width / 2; x++)
+		{
+			u[row * srcPitch[1] + x] = (uint8_t)(100 + row * width + x);
+			v[row * srcPitch[2] + x] = (uint8_t)(200 + row * width + x);
+		}
+	}
+
+	//	Y in the top rows, then U in the left and V in the right half of the rows below, as the shader samples them.
+	std::vector<uint8_t> atlas(dstPitch * (height + height / 2), PADDING);
+	CopyYUVAtlas(atlas.data(), dstPitch, y.data(), u.data(), v.data(), srcPitch, width, height);
+
+	int mismatches = 0;
+	for (int row = 0; row < height + height / 2; row++)
+	{
+		for (int x = 0; x < dstPitch; x++)
+		{
+			uint8_t expected = PADDING;
+			if (x < width && row < height)
+			{
+				expected = (uint8_t)(row * width + x);
+			}
+			else if (x < width / 2)
+			{
+				expected = (uint8_t)(100 + (row - height) * width + x);
+			}
+			else if (x < width)
+			{
+				expected = (uint8_t)(200 + (row - height) * width + x - width / 2);
+			}
+
+			if (atlas[row * dstPitch + x] != expected)
+			{
+				mismatches++;
+			}
+		}
+	}
+	CHECK(mismatches == 0);
+}
+
+//	The per-row loop the backends had before CopyPlane, the reference for the benchmark.
+static void CopyRowsMemcpy(uint8_t* dst, int dstPitch, const uint8_t* src, int srcPitch, int width, int height)
+{
+	for (int y = 0; y < height; y++)
+	{
+		memcpy(dst + (size_t)y * dstPitch, src + (size_t)y * srcPitch, width);
+	}
+}
+
+//	Luma planes between padded rows, into ordinary memory: the old per-row loop, CopyPlane, and CopyPlane down the
+//	path for write-combined memory. Only mapped texture memory is write-combined, so here the streaming stores are
+//	not expected to win.
+void BenchCopyPlane()
+{
+	struct PlaneSize
+	{
+		const char* name;
+		int width;
+		int height;
+	};
+	const char* methods[] = { "per-row loop", "CopyPlane memcpy", "CopyPlane streaming" };
+	const PlaneSize sizes[] = { { "1080p", 1920, 1080 }, { "4K", 3840, 2160 }, { "8K", 7680, 4320 } };
+	//	About the same number of bytes for every size.
+	const double bytesPerSize = 200.0 * 1920 * 1080;
+
+	for (const PlaneSize& size : sizes)
+	{
+		const int srcPitch = size.width + 64;
+		const int dstPitch = size.width + 128;
+		const int rounds = (int)(bytesPerSize / ((double)size.width * size.height));
+
+		std::vector<uint8_t> src((size_t)srcPitch * size.height, 1);
+		std::vector<uint8_t> dst((size_t)dstPitch * size.height, 0);
+
+		double referenceSeconds = 0;
+		for (int method = 0; method < 3; method++)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int i = 0; i < rounds; i++)
+			{
+				if (method == 0)
+				{
+					CopyRowsMemcpy(dst.data(), dstPitch, src.data(), srcPitch, size.width, size.height);
+				}
+				else
+				{
+					CopyPlane(dst.data(), dstPitch, src.data(), srcPitch, size.width, size.height, method == 2);
+				}
+			}
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			if (method == 0)
+			{
+				referenceSeconds = seconds;
+			}
+
+			printf("%-5s %-19s: %7.3f ms per plane, %6.2f GB/s, %.2fx the per-row loop\n", size.name, methods[method],
+				seconds * 1000.0 / rounds, (double)size.width * size.height * rounds / seconds / 1e9, referenceSeconds / seconds);
+		}
+	}
+}
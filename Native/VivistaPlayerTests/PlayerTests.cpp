@@ -0,0 +1,568 @@
+#include "Tests.h"
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Manager.h"
+#include "RenderAPI.h"
+
+extern RenderAPI* CreateRenderAPI_Software();
+
+// Playback of clips in the codecs and frame layouts the player sees in the field.
+static const char* CLIP_PATH = "VivistaPlayerTests_Player.mkv";
+static const int CLIP_WIDTH = 320;
+static const int CLIP_HEIGHT = 240;
+static const int CLIP_FPS = 25;
+static const int CLIP_FRAMES = 50;
+static const int CLIP_GOP = 25;
+static const int CLIP_B_FRAMES = 3;
+
+// The benchmarks decode a larger clip, long enough that the thread pools reach a steady state.
+static const char* BENCH_PATH = "VivistaPlayerTests_Bench.mkv";
+static const ClipFormat BENCH_FORMAT = { "libx264", 1280, 720, 25, 250, 50, 3, false };
+
+//	Presents the frames when they are due, like the render thread. Every frame of the clip has to come out once,
+//	in order, a frame duration apart, and at the pace of the source.
+static void PlayClip(const char* encoder)
+{
+	const ClipFormat format = { encoder, CLIP_WIDTH, CLIP_HEIGHT, CLIP_FPS, CLIP_FRAMES, CLIP_GOP, CLIP_B_FRAMES, false };
+	if (!WriteClip(CLIP_PATH, format))
+	{
+		printf("Writing %s with %s failed, B-frame decoding is not tested\n", CLIP_PATH, encoder);
+		g_Failures++;
+		return;
+	}
+
+	{
+		Manager manager;
+		manager.Init(CLIP_PATH);
+		CHECK(manager.GetPlayerState() == Manager::INITIALIZED);
+		manager.Start();
+
+		const double frameDuration = 1.0 / CLIP_FPS;
+		double lastFrameTime = -1;
+		int shownFrames = 0;
+		int renderSkippedFrames = 0;
+		bool isOrdered = true;
+		std::chrono::steady_clock::time_point firstShown;
+		std::chrono::steady_clock::time_point lastShown;
+
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while (shownFrames < CLIP_FRAMES && std::chrono::steady_clock::now() < deadline)
+		{
+			double presentationTime = manager.GetPresentationTime();
+			renderSkippedFrames += manager.SkipVideoFrames(presentationTime);
+
+			uint8_t* y = NULL;
+			uint8_t* u = NULL;
+			uint8_t* v = NULL;
+			int linesize[3] = {};
+			double frameTime = manager.GetVideoFrame(&y, &u, &v, linesize);
+			if (frameTime != -1 && y != NULL && (presentationTime < 0 || frameTime <= presentationTime))
+			{
+				//	Reordering gone wrong shows up as a frame out of place or a pair with the same time.
+				if (lastFrameTime >= 0 && fabs(frameTime - lastFrameTime - frameDuration) > 0.001)
+				{
+					isOrdered = false;
+				}
+				lastFrameTime = frameTime;
+
+				lastShown = std::chrono::steady_clock::now();
+				if (shownFrames == 0)
+				{
+					firstShown = lastShown;
+				}
+				shownFrames++;
+				manager.FreeVideoFrame();
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+
+		double elapsed = std::chrono::duration<double>(lastShown - firstShown).count();
+		double decodedFps = elapsed > 0 ? (shownFrames - 1) / elapsed : 0;
+		printf("%-8s %d of %d frames at %.1f fps, source %d fps\n", encoder, shownFrames, CLIP_FRAMES, decodedFps,
+			CLIP_FPS);
+
+		CHECK(shownFrames == CLIP_FRAMES);
+		CHECK(isOrdered);
+		CHECK(renderSkippedFrames == 0);
+		CHECK(fabs(decodedFps - CLIP_FPS) < CLIP_FPS * 0.05);
+
+		int droppedFrames, skippedFrames;
+		manager.GetDroppedFrames(droppedFrames, skippedFrames);
+		CHECK(droppedFrames == 0 && skippedFrames == 0);
+
+		manager.Stop();
+	}
+
+	remove(CLIP_PATH);
+}
+
+void TestBFrameDecoding()
+{
+	PlayClip("libx264");
+	PlayClip("libx265");
+}
+
+//	Takes every frame as soon as it is decoded, without waiting for it to be due. Video is the master, so no frame
+//	is dropped for being late. Returns the milliseconds from the start, or from the frame before, to each frame.
+static std::vector<double> DrainFrames(Manager& manager, int frameCount)
+{
+	std::vector<double> gaps;
+	std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point deadline = last + std::chrono::seconds(60);
+	while ((int)gaps.size() < frameCount && std::chrono::steady_clock::now() < deadline)
+	{
+		uint8_t* y = NULL;
+		uint8_t* u = NULL;
+		uint8_t* v = NULL;
+		int linesize[3] = {};
+		if (manager.GetVideoFrame(&y, &u, &v, linesize) != -1 && y != NULL)
+		{
+			manager.FreeVideoFrame();
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			gaps.push_back(std::chrono::duration<double, std::milli>(now - last).count());
+			last = now;
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	return gaps;
+}
+
+//	Decodes the clip with the codec's thread pool at different sizes. 0 is the automatic size the plugin defaults to.
+void BenchDecodeThreads()
+{
+	if (!WriteClip(BENCH_PATH, BENCH_FORMAT))
+	{
+		printf("Writing %s failed, decoding is not benchmarked\n", BENCH_PATH);
+		g_Failures++;
+		return;
+	}
+
+	const int threadCounts[] = { 1, 2, 4, 8, 0 };
+	for (int threadCount : threadCounts)
+	{
+		Manager manager;
+		manager.SetThreadingConfig({ Decoder::THREAD_DEFAULT, threadCount, 0, 0, 0 });
+		manager.Init(BENCH_PATH);
+		manager.SetSyncMaster(Decoder::SYNC_VIDEO);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		manager.Start();
+		std::vector<double> gaps = DrainFrames(manager, BENCH_FORMAT.frames);
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		manager.Stop();
+
+		CHECK((int)gaps.size() == BENCH_FORMAT.frames);
+		printf("%d decode threads%s: %.0f fps, frame latency p50 %.2f ms, p99 %.2f ms\n", threadCount,
+			threadCount == 0 ? " (auto)" : "", gaps.size() / elapsed, Percentile(gaps, 0.5), Percentile(gaps, 0.99));
+	}
+
+	remove(BENCH_PATH);
+}
+
+//	Waits for the first frame of a started player and uploads it through the renderer.
+static bool UploadFirstFrame(Manager& manager, RenderAPI* renderer, YUVTextures* textures)
+{
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while (std::chrono::steady_clock::now() < deadline)
+	{
+		uint8_t* y = NULL;
+		uint8_t* u = NULL;
+		uint8_t* v = NULL;
+		int linesize[3] = {};
+		if (manager.GetVideoFrame(&y, &u, &v, linesize) != -1 && y != NULL)
+		{
+			renderer->UploadYUVFrame(textures, y, u, v, linesize);
+			manager.FreeVideoFrame();
+			return true;
+		}
+
+		std::this_thread::yield();
+	}
+
+	return false;
+}
+
+//	The time from Start to the first frame in the textures, through the software renderer. Without preroll the
+//	decoding starts with Start, with preroll Init has decoded the first frames already and takes that much longer.
+void BenchStartup()
+{
+	if (!WriteClip(BENCH_PATH, BENCH_FORMAT))
+	{
+		printf("Writing %s failed, startup is not benchmarked\n", BENCH_PATH);
+		g_Failures++;
+		return;
+	}
+
+	RenderAPI* renderer = CreateRenderAPI_Software();
+	void* texY = NULL;
+	void* texU = NULL;
+	void* texV = NULL;
+	YUVTextures* textures = renderer->Create(BENCH_FORMAT.width, BENCH_FORMAT.height, YUV_PLANES, &texY, &texU, &texV);
+	if (textures == NULL)
+	{
+		printf("Creating the textures failed, startup is not benchmarked\n");
+		g_Failures++;
+		delete renderer;
+		remove(BENCH_PATH);
+		return;
+	}
+
+	const int runs = 20;
+
+	for (int isPreroll = 0; isPreroll < 2; isPreroll++)
+	{
+		std::vector<double> initTimes;
+		std::vector<double> startTimes;
+		for (int i = 0; i < runs; i++)
+		{
+			Manager manager;
+			manager.SetPreroll(isPreroll != 0);
+
+			std::chrono::steady_clock::time_point initStart = std::chrono::steady_clock::now();
+			manager.Init(BENCH_PATH);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			CHECK(manager.GetPlayerState() == (isPreroll ? Manager::PREROLLED : Manager::INITIALIZED));
+			manager.Start();
+
+			CHECK(UploadFirstFrame(manager, renderer, textures));
+			std::chrono::steady_clock::time_point uploaded = std::chrono::steady_clock::now();
+			initTimes.push_back(std::chrono::duration<double, std::milli>(start - initStart).count());
+			startTimes.push_back(std::chrono::duration<double, std::milli>(uploaded - start).count());
+			manager.Stop();
+		}
+
+		printf("%-10s Init p50 %.1f ms, Start to first upload p50 %.1f ms, p99 %.1f ms\n",
+			isPreroll ? "preroll" : "no preroll", Percentile(initTimes, 0.5), Percentile(startTimes, 0.5),
+			Percentile(startTimes, 0.99));
+	}
+
+	delete textures;
+	delete renderer;
+	remove(BENCH_PATH);
+}
+
+//	Frame rates of one run of several players at once.
+struct PlayersResult
+{
+	double fps;
+	double slowestPlayerFps;
+	std::vector<double> gaps;
+};
+
+//	Plays the benchmark clip on the given number of players at once. One thread takes the frames of all of them
+//	as soon as they are decoded and uploads them through the software renderer, like the render thread would.
+static bool RunPlayers(int playerCount, PlayersResult& result)
+{
+	RenderAPI* renderer = CreateRenderAPI_Software();
+	std::vector<std::unique_ptr<Manager>> players;
+	std::vector<YUVTextures*> textures;
+	for (int i = 0; i < playerCount; i++)
+	{
+		players.emplace_back(new Manager());
+		players.back()->Init(BENCH_PATH);
+		players.back()->SetSyncMaster(Decoder::SYNC_VIDEO);
+
+		void* texY = NULL;
+		void* texU = NULL;
+		void* texV = NULL;
+		textures.push_back(renderer->Create(BENCH_FORMAT.width, BENCH_FORMAT.height, YUV_PLANES, &texY, &texU, &texV));
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (std::unique_ptr<Manager>& player : players)
+	{
+		player->Start();
+	}
+
+	std::vector<int> frameCounts(playerCount, 0);
+	std::vector<std::chrono::steady_clock::time_point> lastFrames(playerCount, start);
+	result.gaps.clear();
+	int remaining = playerCount;
+
+	std::chrono::steady_clock::time_point deadline = start + std::chrono::seconds(120);
+	while (remaining > 0 && std::chrono::steady_clock::now() < deadline)
+	{
+		bool isAnyFrame = false;
+		for (int i = 0; i < playerCount; i++)
+		{
+			uint8_t* y = NULL;
+			uint8_t* u = NULL;
+			uint8_t* v = NULL;
+			int linesize[3] = {};
+			if (frameCounts[i] == BENCH_FORMAT.frames || players[i]->GetVideoFrame(&y, &u, &v, linesize) == -1 || y == NULL)
+			{
+				continue;
+			}
+
+			if (textures[i] != NULL)
+			{
+				renderer->UploadYUVFrame(textures[i], y, u, v, linesize);
+			}
+			players[i]->FreeVideoFrame();
+
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			result.gaps.push_back(std::chrono::duration<double, std::milli>(now - lastFrames[i]).count());
+			lastFrames[i] = now;
+			isAnyFrame = true;
+
+			if (++frameCounts[i] == BENCH_FORMAT.frames)
+			{
+				remaining--;
+			}
+		}
+
+		if (!isAnyFrame)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.fps = result.gaps.size() / elapsed;
+	result.slowestPlayerFps = 0;
+	for (int i = 0; i < playerCount; i++)
+	{
+		double playerFps = frameCounts[i] / std::chrono::duration<double>(lastFrames[i] - start).count();
+		result.slowestPlayerFps = i == 0 ? playerFps : std::min(result.slowestPlayerFps, playerFps);
+		players[i]->Stop();
+		delete textures[i];
+	}
+
+	delete renderer;
+	return remaining == 0;
+}
+
+//	Decodes the same clip on more and more players at once. Once the players share the cores the aggregate rate
+//	should level off rather than drop.
+void BenchPlayers()
+{
+	if (!WriteClip(BENCH_PATH, BENCH_FORMAT))
+	{
+		printf("Writing %s failed, players are not benchmarked\n", BENCH_PATH);
+		g_Failures++;
+		return;
+	}
+
+	const int playerCounts[] = { 1, 2, 4, 8 };
+	for (int playerCount : playerCounts)
+	{
+		PlayersResult result;
+		CHECK(RunPlayers(playerCount, result));
+		printf("%d players: %.0f fps in total, slowest player %.0f fps\n", playerCount, result.fps,
+			result.slowestPlayerFps);
+	}
+
+	remove(BENCH_PATH);
+}
+
+static void PrintPlayersResult(const char* model, int playerCount, PlayersResult& result)
+{
+	printf("%-17s %d players: %.0f fps in total, frame gap p50 %.1f ms, p99 %.1f ms, p99.9 %.1f ms\n", model,
+		playerCount, result.fps, Percentile(result.gaps, 0.5), Percentile(result.gaps, 0.99),
+		Percentile(result.gaps, 0.999));
+}
+
+//	One run of BenchScheduler in a process of its own, whose pool was sized before the first player started.
+void BenchPlayerRun(int playerCount, const char* model)
+{
+	PlayersResult result;
+	CHECK(RunPlayers(playerCount, result));
+	PrintPlayersResult(model, playerCount, result);
+}
+
+//	The shared pool against the thread per stage and player that every player used to start. The pool can't be
+//	resized, so the thread-per-player runs start this executable again with one worker for each stage of each
+//	player, the demux and the video decode of the video-only clip.
+void BenchScheduler(const char* executablePath)
+{
+	if (!WriteClip(BENCH_PATH, BENCH_FORMAT))
+	{
+		printf("Writing %s failed, the scheduler is not benchmarked\n", BENCH_PATH);
+		g_Failures++;
+		return;
+	}
+
+	const int playerCounts[] = { 1, 4, 8 };
+	const int stagesPerPlayer = 2;
+	for (int playerCount : playerCounts)
+	{
+		BenchPlayerRun(playerCount, "shared pool");
+
+		char command[1024];
+		snprintf(command, sizeof(command), "\"%s\" --bench-players %d --workers %d", executablePath, playerCount,
+			playerCount * stagesPerPlayer);
+		fflush(stdout);
+		CHECK(std::system(command) == 0);
+	}
+
+	remove(BENCH_PATH);
+}
+
+//	Plays a 4K clip with audio at different speeds, with the audio pulled at the rate of an audio device and the
+//	frames presented when they are due. Reports the CPU time of the decoder tasks per second of the clip played.
+//	Atempo runs on the audio task. Above 1.5x the video task skips non-reference frames.
+void BenchPlaybackSpeed()
+{
+	const char* path = "VivistaPlayerTests_Speed.mkv";
+	const ClipFormat format = { "libx264", 3840, 2160, 25, 100, 50, 3, true };
+	if (!WriteClip(path, format))
+	{
+		printf("Writing %s failed, playback speed is not benchmarked\n", path);
+		g_Failures++;
+		return;
+	}
+
+	const double speeds[] = { 0.5, 1.0, 2.0, 4.0 };
+	const int sampleRate = 48000;
+	const int channels = 2;
+	const int pullFrames = 1024;
+	const double duration = (double)format.frames / format.fps;
+
+	for (double speed : speeds)
+	{
+		Manager manager;
+		manager.SetAudioOutput(sampleRate, false);
+		manager.Init(path);
+		manager.SetPlaybackSpeed(speed);
+		manager.Start();
+
+		std::vector<float> samples(pullFrames * channels);
+		int64_t pulledFrames = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		//	Stops short of the end, so the tasks aren't idle at EOF for part of the run.
+		std::chrono::steady_clock::time_point end = start + std::chrono::milliseconds((int64_t)(900 * duration / speed));
+		while (std::chrono::steady_clock::now() < end)
+		{
+			double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			while (pulledFrames < (int64_t)(elapsed * sampleRate))
+			{
+				manager.GetAudioSamples(samples.data(), pullFrames, channels);
+				pulledFrames += pullFrames;
+			}
+
+			double presentationTime = manager.GetPresentationTime();
+			manager.SkipVideoFrames(presentationTime);
+
+			uint8_t* y = NULL;
+			uint8_t* u = NULL;
+			uint8_t* v = NULL;
+			int linesize[3] = {};
+			double frameTime = manager.GetVideoFrame(&y, &u, &v, linesize);
+			if (frameTime != -1 && y != NULL && (presentationTime < 0 || frameTime <= presentationTime))
+			{
+				manager.FreeVideoFrame();
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+
+		double played = manager.GetPresentationTime();
+		double demuxSeconds, videoSeconds, audioSeconds;
+		manager.GetTaskCpuTimes(demuxSeconds, videoSeconds, audioSeconds);
+		manager.Stop();
+
+		CHECK(played > 0);
+		played = std::max(played, 0.001);
+		printf("%.1fx: %.1f s played, CPU per second played: audio %.1f ms, video %.1f ms, demux %.1f ms\n", speed,
+			played, 1000 * audioSeconds / played, 1000 * videoSeconds / played, 1000 * demuxSeconds / played);
+	}
+
+	remove(path);
+}
+
+//	A scene jump from a playing clip to the next one, until the first frame of the next clip is in the textures.
+//	Before: the old player is destroyed, then the next clip is opened and started, like NativeDestroy,
+//	NativeInitDecoder and NativeStart. After: the next clip was preloaded with preroll at low priority while the
+//	old one played, the swap starts it and stops the old player on a thread of its own, like NativeSwapPlayers.
+void BenchTransition()
+{
+	if (!WriteClip(BENCH_PATH, BENCH_FORMAT))
+	{
+		printf("Writing %s failed, transitions are not benchmarked\n", BENCH_PATH);
+		g_Failures++;
+		return;
+	}
+
+	RenderAPI* renderer = CreateRenderAPI_Software();
+	void* texY = NULL;
+	void* texU = NULL;
+	void* texV = NULL;
+	YUVTextures* textures = renderer->Create(BENCH_FORMAT.width, BENCH_FORMAT.height, YUV_PLANES, &texY, &texU, &texV);
+	if (textures == NULL)
+	{
+		printf("Creating the textures failed, transitions are not benchmarked\n");
+		g_Failures++;
+		delete renderer;
+		remove(BENCH_PATH);
+		return;
+	}
+
+	const int runs = 10;
+	const int playedFrames = 25;
+	std::vector<double> before;
+	std::vector<double> after;
+
+	for (int i = 0; i < runs; i++)
+	{
+		std::unique_ptr<Manager> current(new Manager());
+		current->Init(BENCH_PATH);
+		current->Start();
+		DrainFrames(*current, playedFrames);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		current->Stop();
+		current.reset(new Manager());
+		current->Init(BENCH_PATH);
+		current->Start();
+		CHECK(UploadFirstFrame(*current, renderer, textures));
+		before.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		current->Stop();
+	}
+
+	for (int i = 0; i < runs; i++)
+	{
+		std::unique_ptr<Manager> current(new Manager());
+		current->Init(BENCH_PATH);
+		current->Start();
+
+		std::unique_ptr<Manager> next(new Manager());
+		next->SetPreroll(true);
+		next->SetPriority(Scheduler::PRIORITY_LOW);
+		std::thread preload([&next] { next->Init(BENCH_PATH); });
+		DrainFrames(*current, playedFrames);
+		preload.join();
+		CHECK(next->GetPlayerState() == Manager::PREROLLED);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		current.swap(next);
+		std::thread retire([old = std::move(next)] { old->Stop(); });
+		current->SetPriority(Scheduler::PRIORITY_NORMAL);
+		current->Start();
+		CHECK(UploadFirstFrame(*current, renderer, textures));
+		after.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+		retire.join();
+		current->Stop();
+	}
+
+	printf("Transition to the first upload: before p50 %.1f ms, p99 %.1f ms, after p50 %.1f ms, p99 %.1f ms\n",
+		Percentile(before, 0.5), Percentile(before, 0.99), Percentile(after, 0.5), Percentile(after, 0.99));
+
+	delete textures;
+	delete renderer;
+	remove(BENCH_PATH);
+}
@@ -0,0 +1,65 @@
+#include "Tests.h"
+
+#include <chrono>
+#include <vector>
+
+#include "RenderAPI.h"
+
+extern RenderAPI* CreateRenderAPI_Software();
+
+//	Uploads frames with decoder-like padded rows through the software renderer, once into three planes and once
+//	into the atlas. The software renderer counts the Map and Unmap calls the D3D11 backend makes for the same upload.
+void BenchYUVUpload()
+{
+	struct FrameSize
+	{
+		const char* name;
+		int width;
+		int height;
+	};
+	const FrameSize sizes[] = { { "1080p", 1920, 1080 }, { "4K", 3840, 2160 } };
+	const YUVLayout layouts[] = { YUV_PLANES, YUV_ATLAS };
+	const int frames = 200;
+
+	RenderAPI* renderer = CreateRenderAPI_Software();
+
+	for (const FrameSize& size : sizes)
+	{
+		const int linesize[3] = { size.width + 32, size.width / 2 + 32, size.width / 2 + 32 };
+		std::vector<uint8_t> y((size_t)linesize[0] * size.height, 16);
+		std::vector<uint8_t> u((size_t)linesize[1] * size.height / 2, 128);
+		std::vector<uint8_t> v((size_t)linesize[2] * size.height / 2, 128);
+
+		for (YUVLayout layout : layouts)
+		{
+			void* texY = NULL;
+			void* texU = NULL;
+			void* texV = NULL;
+			YUVTextures* textures = renderer->Create(size.width, size.height, layout, &texY, &texU, &texV);
+			if (textures == NULL)
+			{
+				printf("Creating the %s textures failed\n", size.name);
+				g_Failures++;
+				continue;
+			}
+
+			std::vector<double> samples;
+			for (int i = 0; i < frames; i++)
+			{
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				renderer->UploadYUVFrame(textures, y.data(), u.data(), v.data(), linesize);
+				samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+			}
+
+			UploadStats stats = {};
+			renderer->GetUploadStats(textures, &stats);
+			printf("%-5s %-6s upload: p50 %.0f us, p99 %.0f us, %.1f driver calls per frame\n", size.name,
+				layout == YUV_ATLAS ? "atlas" : "planes", Percentile(samples, 0.5), Percentile(samples, 0.99),
+				(double)stats.driverCalls / stats.uploadCount);
+
+			delete textures;
+		}
+	}
+
+	delete renderer;
+}
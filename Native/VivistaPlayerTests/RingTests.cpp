@@ -0,0 +1,322 @@
+#include "Tests.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+#include "FrameRing.h"
+#include "AudioRing.h"
+#include "PacketQueue.h"
+
+void TestFrameRing()
+{
+	FrameRing<int> ring(3);
+	CHECK(ring.Capacity() == 4);
+
+	//	Many times around, so the positions wrap in the storage.
+	int value;
+	for (int i = 0; i < 10; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			CHECK(ring.Push(i * 4 + j));
+		}
+		CHECK(!ring.Push(-1));
+		CHECK(ring.Size() == 4);
+
+		CHECK(ring.Peek(2, &value) && value == i * 4 + 2);
+		CHECK(!ring.Peek(4, &value));
+
+		for (int j = 0; j < 4; j++)
+		{
+			CHECK(ring.Front(&value) && value == i * 4 + j);
+			CHECK(ring.Pop(&value) && value == i * 4 + j);
+		}
+		CHECK(!ring.Pop(&value));
+	}
+
+	//	One producer and one consumer, nothing may get lost or reordered.
+	const int count = 100000;
+	FrameRing<int> shared(16);
+	std::thread producer([&shared, count] {
+		for (int i = 0; i < count; i++)
+		{
+			while (!shared.Push(i))
+			{
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	int expected = 0;
+	while (expected < count)
+	{
+		if (shared.Pop(&value))
+		{
+			if (value != expected)
+			{
+				break;
+			}
+			expected++;
+		}
+	}
+	producer.join();
+	CHECK(expected == count);
+}
+
+void TestAudioRing()
+{
+	AudioRing ring;
+	ring.Init(1000);
+	CHECK(ring.Capacity() == 1024);
+
+	std::vector<float> input(2048);
+	std::vector<float> output(2048);
+	for (size_t i = 0; i < input.size(); i++)
+	{
+		input[i] = (float)i;
+	}
+
+	//	The second write goes around the end of the storage.
+	CHECK(ring.Write(input.data(), 600) == 600);
+	CHECK(ring.Read(output.data(), 200) == 200);
+	CHECK(output[0] == 0.0f && output[199] == 199.0f);
+	CHECK(ring.Write(input.data() + 600, 1000) == 624);
+	CHECK(ring.Space() == 0);
+	CHECK(ring.Read(output.data(), 1024) == 1024);
+	CHECK(output[0] == 200.0f && output[1023] == 1223.0f);
+
+	//	A seek: what was written before belongs to the old position and is skipped, the time mark carries the new serial.
+	const double samplesPerSecond = 10.0;
+	double time;
+	int serial;
+	CHECK(ring.Write(input.data(), 100) == 100);
+	ring.Discard();
+	ring.MarkTime(20.0, 2);
+	CHECK(ring.Write(input.data() + 1000, 50) == 50);
+	CHECK(ring.DropDiscarded());
+	CHECK(ring.Size() == 50);
+	CHECK(ring.GetReadTime(samplesPerSecond, &time, &serial) && time == 20.0 && serial == 2);
+
+	ring.MarkTime(25.0, 2);
+	CHECK(ring.Write(input.data() + 1050, 50) == 50);
+	CHECK(ring.Read(output.data(), 10) == 10);
+	CHECK(output[0] == 1000.0f);
+	CHECK(ring.GetReadTime(samplesPerSecond, &time, &serial) && time == 21.0 && serial == 2);
+
+	//	Once the read position is past it, the old discard position does nothing, however far playback goes on.
+	for (int i = 0; i < 100; i++)
+	{
+		ring.Write(input.data(), 500);
+		ring.Read(output.data(), 500);
+		CHECK(!ring.DropDiscarded());
+	}
+	CHECK(ring.Size() == 90);
+}
+
+static bool PutPacket(PacketQueue& queue, int size)
+{
+	AVPacket packet;
+	av_init_packet(&packet);
+	if (av_new_packet(&packet, size) < 0)
+	{
+		return false;
+	}
+
+	bool isQueued = queue.Put(&packet);
+	av_packet_unref(&packet);
+	return isQueued;
+}
+
+void TestPacketQueue()
+{
+	PacketQueue queue;
+	queue.Init(1000, 4);
+
+	//	Aborted until started, nothing gets in.
+	CHECK(!PutPacket(queue, 10));
+	CHECK(queue.GetCount() == 0);
+
+	queue.Start();
+	CHECK(PutPacket(queue, 100));
+	CHECK(PutPacket(queue, 100));
+	CHECK(queue.GetSize() == 200 && queue.GetSerial() == 0);
+
+	//	A flush drops what is queued and starts a new serial, the flush packet itself is the first one out.
+	CHECK(queue.PutFlush());
+	CHECK(queue.GetCount() == 1 && queue.GetSize() == 0 && queue.GetSerial() == 1);
+	CHECK(PutPacket(queue, 50));
+
+	AVPacket packet;
+	av_init_packet(&packet);
+	int serial = -1;
+	CHECK(queue.Get(&packet, false, &serial) == PacketQueue::AVAILABLE);
+	CHECK(PacketQueue::IsFlushPacket(&packet) && serial == 1);
+	av_packet_unref(&packet);
+
+	CHECK(queue.Get(&packet, false, &serial) == PacketQueue::AVAILABLE);
+	CHECK(!PacketQueue::IsFlushPacket(&packet) && packet.size == 50 && serial == 1);
+	av_packet_unref(&packet);
+	CHECK(queue.Get(&packet, false, &serial) == PacketQueue::EMPTY);
+
+	//	An empty queue is never full, the count limit counts.
+	for (int i = 0; i < 4; i++)
+	{
+		CHECK(!queue.IsFull());
+		CHECK(PutPacket(queue, 10));
+	}
+	CHECK(queue.IsFull());
+
+	//	A blocked Get() returns when the queue is aborted, and Put() refuses from then on.
+	std::thread consumer([&queue] {
+		AVPacket taken;
+		av_init_packet(&taken);
+		while (queue.Get(&taken, true) == PacketQueue::AVAILABLE)
+		{
+			av_packet_unref(&taken);
+		}
+	});
+	queue.Abort();
+	consumer.join();
+	CHECK(!PutPacket(queue, 10));
+	CHECK(queue.Get(&packet, true) == PacketQueue::ABORTED);
+}
+
+// The frame queues as they were before the rings: a std::queue that both threads lock for every access.
+template<typename T>
+class MutexQueue
+{
+public:
+	explicit MutexQueue(unsigned int capacity)
+	{
+		this->capacity = capacity;
+	}
+
+	bool Push(const T& item)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (items.size() >= capacity)
+		{
+			return false;
+		}
+
+		items.push(item);
+		return true;
+	}
+
+	bool Pop(T* item)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (items.empty())
+		{
+			return false;
+		}
+
+		*item = items.front();
+		items.pop();
+		return true;
+	}
+
+private:
+	std::queue<T>	items;
+	unsigned int	capacity;
+	std::mutex		mutex;
+};
+
+static double NanosecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void PrintDistribution(const char* queueName, const char* name, std::vector<double>& samples)
+{
+	printf("%s %s: p50 %.0f ns, p99 %.0f ns, p99.9 %.0f ns, max %.0f ns\n", queueName, name,
+		Percentile(samples, 0.5), Percentile(samples, 0.99), Percentile(samples, 0.999), Percentile(samples, 1.0));
+}
+
+//	A decoder thread pushes frames as fast as the queue takes them, the render thread takes a few out every
+//	millisecond. Reports how long single Push() and Pop() calls take, and how much the time the render thread
+//	spends on its queue work varies from tick to tick.
+template<typename Queue>
+static void BenchQueue(const char* queueName, Queue& queue)
+{
+	const int ticks = 2000;
+	const int framesPerTick = 4;
+
+	std::vector<double> pushTimes;
+	std::vector<double> popTimes;
+	std::vector<double> tickTimes;
+	pushTimes.reserve(ticks * framesPerTick * 2);
+	popTimes.reserve(ticks * framesPerTick);
+	tickTimes.reserve(ticks);
+
+	std::atomic<bool> isDone(false);
+	std::thread producer([&queue, &isDone, &pushTimes] {
+		int frame = 0;
+		while (!isDone)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if (queue.Push(frame))
+			{
+				pushTimes.push_back(NanosecondsSince(start));
+				frame++;
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	std::chrono::steady_clock::time_point nextTick = std::chrono::steady_clock::now();
+	for (int i = 0; i < ticks; i++)
+	{
+		nextTick += std::chrono::milliseconds(1);
+		std::this_thread::sleep_until(nextTick);
+
+		std::chrono::steady_clock::time_point tickStart = std::chrono::steady_clock::now();
+		for (int j = 0; j < framesPerTick; j++)
+		{
+			int frame;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if (queue.Pop(&frame))
+			{
+				popTimes.push_back(NanosecondsSince(start));
+			}
+		}
+		tickTimes.push_back(NanosecondsSince(tickStart));
+	}
+
+	isDone = true;
+	producer.join();
+
+	double mean = 0;
+	for (double time : tickTimes)
+	{
+		mean += time;
+	}
+	mean /= tickTimes.size();
+	double variance = 0;
+	for (double time : tickTimes)
+	{
+		variance += (time - mean) * (time - mean);
+	}
+
+	PrintDistribution(queueName, "push", pushTimes);
+	PrintDistribution(queueName, "pop", popTimes);
+	PrintDistribution(queueName, "render tick", tickTimes);
+	printf("%s render tick jitter: %.0f ns standard deviation, %.0f ns p99 - p50\n", queueName,
+		sqrt(variance / tickTimes.size()), Percentile(tickTimes, 0.99) - Percentile(tickTimes, 0.5));
+}
+
+void BenchFrameRing()
+{
+	MutexQueue<int> mutexQueue(16);
+	BenchQueue("mutex queue", mutexQueue);
+
+	FrameRing<int> ring(16);
+	BenchQueue("FrameRing", ring);
+}
@@ -0,0 +1,301 @@
+#include "Tests.h"
+
+#include <chrono>
+#include <math.h>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+
+#include "Manager.h"
+
+// A short clip the test writes itself: 2 seconds of small MPEG-4 frames, a keyframe every 5 frames.
+// Matroska writes cues, so the seeks go through the keyframes in the container index.
+static const char* CLIP_PATH = "VivistaPlayerTests.mkv";
+static const int CLIP_SIZE = 64;
+static const int CLIP_FPS = 25;
+static const int CLIP_FRAMES = 50;
+static const int CLIP_GOP = 5;
+static const ClipFormat CLIP_FORMAT = { "mpeg4", CLIP_SIZE, CLIP_SIZE, CLIP_FPS, CLIP_FRAMES, CLIP_GOP, 0, false };
+
+//	Takes the frames out like the render thread would, until the player is in the given state.
+static bool WaitForState(Manager& manager, Manager::PlayerState state)
+{
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while (std::chrono::steady_clock::now() < deadline)
+	{
+		if (manager.GetPlayerState() == state)
+		{
+			return true;
+		}
+
+		uint8_t* y = NULL;
+		uint8_t* u = NULL;
+		uint8_t* v = NULL;
+		int linesize[3] = {};
+		if (manager.GetVideoFrame(&y, &u, &v, linesize) != -1 && y != NULL)
+		{
+			manager.FreeVideoFrame();
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	return false;
+}
+
+//	The time of the first frame the render thread gets once a seek to the given time has settled.
+static double SeekAndGetFrame(Manager& manager, float time)
+{
+	manager.Seek(time);
+	if (!WaitForState(manager, Manager::PLAYING))
+	{
+		return -1;
+	}
+
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while (std::chrono::steady_clock::now() < deadline)
+	{
+		uint8_t* y = NULL;
+		uint8_t* u = NULL;
+		uint8_t* v = NULL;
+		int linesize[3] = {};
+		double frameTime = manager.GetVideoFrame(&y, &u, &v, linesize);
+		if (frameTime != -1 && y != NULL)
+		{
+			manager.FreeVideoFrame();
+			return frameTime;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	return -1;
+}
+
+void TestExactSeek()
+{
+	if (!WriteClip(CLIP_PATH, CLIP_FORMAT))
+	{
+		printf("Writing %s failed, seeking is not tested\n", CLIP_PATH);
+		g_Failures++;
+		return;
+	}
+
+	{
+		Manager manager;
+		manager.Init(CLIP_PATH);
+		CHECK(manager.GetPlayerState() == Manager::INITIALIZED);
+		manager.Start();
+		CHECK(WaitForState(manager, Manager::PLAYING));
+
+		//	On a keyframe, in the middle of a GOP, and back to the start. The frame shown first is the one that
+		//	covers the target, not the keyframe before it.
+		const double frameDuration = 1.0 / CLIP_FPS;
+		CHECK(fabs(SeekAndGetFrame(manager, 1.2f) - 30 * frameDuration) < 0.001);
+		CHECK(fabs(SeekAndGetFrame(manager, 0.9f) - 22 * frameDuration) < 0.001);
+		CHECK(fabs(SeekAndGetFrame(manager, 0.0f)) < 0.001);
+
+		manager.Stop();
+	}
+
+	remove(CLIP_PATH);
+}
+
+//	Takes the frames out like the render thread would, until the seek of the given generation has settled.
+static bool WaitForSeek(Manager& manager, int generation)
+{
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while (std::chrono::steady_clock::now() < deadline)
+	{
+		uint8_t* y = NULL;
+		uint8_t* u = NULL;
+		uint8_t* v = NULL;
+		int linesize[3] = {};
+		if (manager.GetVideoFrame(&y, &u, &v, linesize) != -1 && y != NULL)
+		{
+			manager.FreeVideoFrame();
+		}
+
+		if (manager.GetSeekGeneration() == generation && manager.GetPlayerState() != Manager::SEEK)
+		{
+			return true;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	return false;
+}
+
+void TestSeekCoalescing()
+{
+	if (!WriteClip(CLIP_PATH, CLIP_FORMAT))
+	{
+		printf("Writing %s failed, seeking is not tested\n", CLIP_PATH);
+		g_Failures++;
+		return;
+	}
+
+	{
+		Manager manager;
+		manager.Init(CLIP_PATH);
+		CHECK(manager.GetPlayerState() == Manager::INITIALIZED);
+
+		int requested, coalesced, completed;
+		float settleTime;
+
+		//	Before the start only the newest target is kept, the start begins with seeking there.
+		manager.Seek(0.4f);
+		manager.Seek(0.8f);
+		manager.Seek(1.2f);
+		manager.GetSeekStats(requested, coalesced, completed, settleTime);
+		CHECK(requested == 3 && coalesced == 2 && completed == 0);
+		CHECK(manager.GetPlayerState() == Manager::INITIALIZED);
+
+		manager.Start();
+		CHECK(WaitForSeek(manager, 3));
+		manager.GetSeekStats(requested, coalesced, completed, settleTime);
+		CHECK(completed == 1);
+
+		//	Scrubbing: a burst of seeks while playing settles once, on the last target. Every request either
+		//	starts a burst that completes or is coalesced into the running one.
+		for (int i = 0; i < 5; i++)
+		{
+			manager.Seek(0.2f * i);
+		}
+		CHECK(WaitForSeek(manager, 8));
+		manager.GetSeekStats(requested, coalesced, completed, settleTime);
+		CHECK(requested == 8 && coalesced > 2 && coalesced + completed == requested);
+		CHECK(manager.GetPlayerState() == Manager::PLAYING || manager.GetPlayerState() == Manager::PLAY_EOF);
+
+		manager.Stop();
+		CHECK(manager.GetPlayerState() == Manager::STOP);
+	}
+
+	remove(CLIP_PATH);
+}
+
+void TestLoop()
+{
+	if (!WriteClip(CLIP_PATH, CLIP_FORMAT))
+	{
+		printf("Writing %s failed, looping is not tested\n", CLIP_PATH);
+		g_Failures++;
+		return;
+	}
+
+	{
+		Manager manager;
+		manager.Init(CLIP_PATH);
+		CHECK(manager.GetPlayerState() == Manager::INITIALIZED);
+		manager.SetLoop(true, 0.0);
+		manager.Start();
+
+		//	Presents frames when they are due, like the render thread, until well into the second iteration.
+		//	Every state the player goes through is recorded.
+		const double frameDuration = 1.0 / CLIP_FPS;
+		const double clipDuration = CLIP_FRAMES * frameDuration;
+		std::vector<Manager::PlayerState> states;
+		double lastFrameTime = -1;
+		int shownFrames = 0;
+		int renderSkippedFrames = 0;
+		bool isOrdered = true;
+
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while (lastFrameTime < clipDuration + 0.5 && std::chrono::steady_clock::now() < deadline)
+		{
+			Manager::PlayerState state = manager.GetPlayerState();
+			if (states.empty() || states.back() != state)
+			{
+				states.push_back(state);
+			}
+
+			double presentationTime = manager.GetPresentationTime();
+			renderSkippedFrames += manager.SkipVideoFrames(presentationTime);
+
+			uint8_t* y = NULL;
+			uint8_t* u = NULL;
+			uint8_t* v = NULL;
+			int linesize[3] = {};
+			double frameTime = manager.GetVideoFrame(&y, &u, &v, linesize);
+			if (frameTime != -1 && y != NULL && (presentationTime < 0 || frameTime <= presentationTime))
+			{
+				//	The iterations follow each other in time, so nothing after the wrap looks late or stale.
+				if (lastFrameTime >= 0 && fabs(frameTime - lastFrameTime - frameDuration) > 0.001)
+				{
+					isOrdered = false;
+				}
+				lastFrameTime = frameTime;
+				shownFrames++;
+				manager.FreeVideoFrame();
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+
+		CHECK(lastFrameTime >= clipDuration + 0.5);
+		CHECK(isOrdered);
+		CHECK(shownFrames > CLIP_FRAMES);
+		CHECK(renderSkippedFrames == 0);
+
+		int droppedFrames, skippedFrames;
+		manager.GetDroppedFrames(droppedFrames, skippedFrames);
+		CHECK(droppedFrames == 0 && skippedFrames == 0);
+
+		//	Straight from the start into playing, and it stays there across the wrap.
+		for (Manager::PlayerState state : states)
+		{
+			CHECK(state != Manager::SEEK && state != Manager::BUFFERING && state != Manager::PLAY_EOF);
+		}
+		CHECK(states.back() == Manager::PLAYING);
+
+		manager.Stop();
+	}
+
+	remove(CLIP_PATH);
+}
+
+//	Exact seeks decode from the keyframe before the target, so the time to the first frame grows with the distance
+//	between keyframes. The clip is the same at every GOP length, from all keyframes to a single one.
+void BenchSeekLatency()
+{
+	const char* path = "VivistaPlayerTests_Seek.mkv";
+	const int gops[] = { 1, 10, 50, 250 };
+	const int seeks = 20;
+
+	for (int gop : gops)
+	{
+		const ClipFormat format = { "mpeg4", 640, 360, 25, 250, gop, 0, false };
+		if (!WriteClip(path, format))
+		{
+			printf("Writing %s failed, seeking is not benchmarked\n", path);
+			g_Failures++;
+			return;
+		}
+
+		{
+			Manager manager;
+			manager.Init(path);
+			manager.Start();
+			CHECK(WaitForState(manager, Manager::PLAYING));
+
+			//	Targets spread over the clip in a fixed order, each at some distance into its GOP.
+			const double duration = (double)format.frames / format.fps;
+			std::vector<double> samples;
+			for (int i = 0; i < seeks; i++)
+			{
+				float target = (float)(duration * ((i * 7) % seeks + 0.5) / (seeks + 1));
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				double frameTime = SeekAndGetFrame(manager, target);
+				samples.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+				CHECK(frameTime >= 0 && fabs(frameTime - target) < 1.0 / format.fps);
+			}
+
+			manager.Stop();
+			printf("GOP %3d seek to first frame: p50 %.1f ms, p99 %.1f ms, max %.1f ms\n", gop,
+				Percentile(samples, 0.5), Percentile(samples, 0.99), samples.back());
+		}
+
+		remove(path);
+	}
+}
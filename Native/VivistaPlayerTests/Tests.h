@@ -0,0 +1,58 @@
+#pragma once
+#include <stdio.h>
+#include <vector>
+
+// A failed check is reported and counted, the test goes on.
+extern int g_Failures;
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			g_Failures++; \
+		} \
+	} while (0)
+
+// The value below which the given fraction of the samples lies. Sorts the samples.
+double Percentile(std::vector<double>& samples, double fraction);
+
+// A clip the tests write themselves, with a gradient that moves every frame and optionally a tone.
+struct ClipFormat
+{
+	const char* encoder;
+	int width;
+	int height;
+	int fps;
+	int frames;
+	int gop;
+	int maxBFrames;
+	bool hasAudio;
+};
+
+// Encodes the clip into a container chosen by the file extension. False if any step fails.
+bool WriteClip(const char* path, const ClipFormat& format);
+
+void TestFrameRing();
+void TestAudioRing();
+void TestPacketQueue();
+void TestClock();
+void TestExactSeek();
+void TestSeekCoalescing();
+void TestLoop();
+void TestBFrameDecoding();
+void TestCopyPlane();
+void TestYUVAtlas();
+
+void BenchFrameRing();
+void BenchCopyPlane();
+void BenchYUVUpload();
+void BenchDecodeThreads();
+void BenchSeekLatency();
+void BenchStartup();
+void BenchPlayers();
+void BenchScheduler(const char* executablePath);
+void BenchPlayerRun(int playerCount, const char* model);
+void BenchPlaybackSpeed();
+void BenchTransition();
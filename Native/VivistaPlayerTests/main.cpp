@@ -0,0 +1,75 @@
+#include "Tests.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Scheduler.h"
+
+// Checks of the plugin internals, without Unity. Returns the number of failed checks.
+// With --bench it also runs the benchmarks. BenchScheduler runs this executable again with
+// --bench-players <count> --workers <count> for a single run with a pool of the given size.
+
+int g_Failures = 0;
+
+double Percentile(std::vector<double>& samples, double fraction)
+{
+	if (samples.empty())
+	{
+		return 0;
+	}
+
+	std::sort(samples.begin(), samples.end());
+	size_t index = (size_t)(fraction * (samples.size() - 1) + 0.5);
+	return samples[index];
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 4 && strcmp(argv[1], "--bench-players") == 0 && strcmp(argv[3], "--workers") == 0)
+	{
+		Scheduler::SetWorkerCount((unsigned int)atoi(argv[4]));
+		BenchPlayerRun(atoi(argv[2]), "thread per player");
+		Scheduler::Shutdown();
+		return g_Failures;
+	}
+
+	TestFrameRing();
+	TestAudioRing();
+	TestPacketQueue();
+	TestClock();
+	TestExactSeek();
+	TestSeekCoalescing();
+	TestLoop();
+	TestBFrameDecoding();
+	TestCopyPlane();
+	TestYUVAtlas();
+
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+	{
+		BenchFrameRing();
+		BenchCopyPlane();
+		BenchYUVUpload();
+		BenchDecodeThreads();
+		BenchSeekLatency();
+		BenchStartup();
+		BenchPlayers();
+		BenchScheduler(argv[0]);
+		BenchPlaybackSpeed();
+		BenchTransition();
+	}
+
+	//	Like the plugin unload, every task is done by now.
+	Scheduler::Shutdown();
+
+	if (g_Failures == 0)
+	{
+		printf("All checks passed\n");
+	}
+	else
+	{
+		printf("%d checks failed\n", g_Failures);
+	}
+
+	return g_Failures;
+}
@@ -34,14 +34,21 @@ public class VivistaPlayer : MonoBehaviour
 	// Native plugin rendering events are only called if a plugin is used
 	// by some script. This means we have to DllImport at least
 	// one function in some active script.
-	// For this example, we'll call into plugin's SetTimeFromUnity
-	// function and pass the current time so the plugin can animate.
 
 	[DllImport("VivistaPlayer")]
-	private static extern void SetTimeFromUnity(float t);
+	private static extern void NativeSetSyncMaster(int id, int master);
 
 	[DllImport("VivistaPlayer")]
-	private static extern void NativeDestroy();
+	private static extern double NativeGetPresentationTime(int id);
+
+	[DllImport("VivistaPlayer")]
+	private static extern void NativeSetPlaybackSpeed(int id, float speed);
+
+	[DllImport("VivistaPlayer")]
+	private static extern void NativeSetLoop(int id, bool isEnabled, float loopStart);
+
+	[DllImport("VivistaPlayer")]
+	private static extern void NativeDestroy(int id);
 
 	[DllImport("VivistaPlayer")]
 	private static extern void SetVideoDisabledNative(bool status);
@@ -53,19 +60,55 @@ public class VivistaPlayer : MonoBehaviour
 	private static extern IntPtr GetUpdateFunc();
 
 	[DllImport("VivistaPlayer")]
-	private static extern bool NativeCreateTexture(ref IntPtr y, ref IntPtr u, ref IntPtr v);
+	private static extern void NativeSetTextureLayout(int id, int layout);
+
+	[DllImport("VivistaPlayer")]
+	private static extern bool NativeCreateTexture(int id, ref IntPtr y, ref IntPtr u, ref IntPtr v);
 
 	[DllImport("VivistaPlayer")]
 	private static extern void NativeInitDecoder(string path, ref int id);
 
+	[DllImport("VivistaPlayer")]
+	private static extern int NativePreload(string path, ref int preloadId);
+
+	[DllImport("VivistaPlayer")]
+	private static extern bool NativeSwapPlayers(int id, int preloadId);
+
 	[DllImport("VivistaPlayer")]
 	private static extern int NativeGetPlayerState(int id);
 
 	[DllImport("VivistaPlayer")]
-	private static extern bool NativeStart();
+	private static extern bool NativeStart(int id);
 
 	[DllImport("VivistaPlayer")]
-	private static extern VideoInfo NativeGetVideoInfo();
+	private static extern void NativeSetBufferLimits(int id, long maxBytes, float maxSeconds);
+
+	[DllImport("VivistaPlayer")]
+	private static extern void NativeSetDecoderThreading(int threadType, int videoThreadCount, int audioThreadCount, ulong videoAffinity, ulong audioAffinity);
+
+	[DllImport("VivistaPlayer")]
+	private static extern void NativeSetCacheDirectory(string directory);
+
+	[DllImport("VivistaPlayer")]
+	private static extern void NativeSetFastOpen(bool isEnabled);
+
+	[DllImport("VivistaPlayer")]
+	private static extern void NativeSetPreroll(bool isEnabled);
+
+	[DllImport("VivistaPlayer")]
+	private static extern void NativeSetPriority(int id, int priority);
+
+	[DllImport("VivistaPlayer")]
+	private static extern void NativeSetAudioOutput(int sampleRate, bool keepAllChannels);
+
+	[DllImport("VivistaPlayer")]
+	private static extern int NativeGetAudioSamples(int id, float[] samples, int frameCount, int channels);
+
+	[DllImport("VivistaPlayer")]
+	private static extern void NativeGetAudioStats(int id, ref int underruns, ref int overruns);
+
+	[DllImport("VivistaPlayer")]
+	private static extern VideoInfo NativeGetVideoInfo(int id);
 
 	[DllImport("VivistaPlayer")]
 	private static extern void RegisterDebugLogCallback(DebugLogCallback logCallback);
@@ -79,6 +122,40 @@ public class VivistaPlayer : MonoBehaviour
 	public bool playOnAwake = false;
 	public string url = null;
 	public float playbackSpeed = 1.0f;
+	// Limits for the decoded frames buffered ahead, 0 uses the native default
+	public int bufferMegabytes = 0;
+	public float bufferSeconds = 0;
+	// Decoder threads per player, 0 uses one per core. Lower this when several players are open at once.
+	public int decoderThreadCount = 0;
+	// Skips stream probing when the container header or an earlier open of the same file tells enough.
+	public bool fastOpen = false;
+	// Decodes the first frames while initializing, so the video shows up as soon as it is started.
+	public bool preroll = false;
+	// All players decode on one shared pool of threads. When it is busy, players with a higher priority go first.
+	public DecodePriority priority = DecodePriority.Normal;
+	// Passes every audio channel through instead of downmixing to stereo, e.g. for ambisonic audio.
+	public bool keepAllAudioChannels = false;
+	// The clock that video and audio follow. Falls back to External while there is no audio playing.
+	public SyncMaster syncMaster = SyncMaster.Audio;
+	// Loops without a stall. Every iteration after the first starts at the keyframe at or before loopStart, in seconds.
+	public bool loop = false;
+	public float loopStart = 0;
+	// Puts Y, U and V into one texture, so every frame is uploaded in one go and the shader samples one texture.
+	public bool atlasTexture = false;
+
+	public enum SyncMaster
+	{
+		Audio,
+		Video,
+		External
+	}
+
+	public enum DecodePriority
+	{
+		High,
+		Normal,
+		Low
+	}
 
 	public enum PlayerState
 	{
@@ -124,7 +201,18 @@ public class VivistaPlayer : MonoBehaviour
 	private Texture2D videoTexU;
 	private Texture2D videoTexV;
 
+	// The next clip, opened and prerolled in the background by Preload
+	private int preloadId = -1;
+	private bool isPreloadReady = false;
+	private string preloadUrl = null;
+	private int preloadWidth = -1;
+	private int preloadHeight = -1;
+	private Texture2D preloadTexY;
+	private Texture2D preloadTexU;
+	private Texture2D preloadTexV;
+
 	private IntPtr nativeUpdateFunc;
+	private bool isRenderLoopRunning = false;
 
 	private void Awake()
 	{
@@ -168,7 +256,8 @@ public class VivistaPlayer : MonoBehaviour
 #if UNITY_EDITOR
 	private void OnDestroy()
 	{
-		NativeDestroy();
+		DiscardPreload();
+		NativeDestroy(decoderId);
 	}
 #endif
 
@@ -184,6 +273,11 @@ public class VivistaPlayer : MonoBehaviour
 
 		url = path;
 		decoderId = -1;
+		NativeSetDecoderThreading(0, decoderThreadCount, 0, 0, 0);
+		NativeSetCacheDirectory(Application.temporaryCachePath);
+		NativeSetFastOpen(fastOpen);
+		NativeSetPreroll(preroll);
+		NativeSetAudioOutput(AudioSettings.outputSampleRate, keepAllAudioChannels);
 		NativeInitDecoder(path, ref decoderId);
 
 		int result;
@@ -192,10 +286,15 @@ public class VivistaPlayer : MonoBehaviour
 			yield return null;
 			result = NativeGetPlayerState(decoderId);
 		}
-		while (result != 1 && result != -1);
+		while (result != 1 && result != -1 && result != 8);
 
-		if (result == 1)
+		// 1 is INITIALIZED, 8 is PREROLLED
+		if (result == 1 || result == 8)
 		{
+			NativeSetPriority(decoderId, (int)priority);
+			NativeSetSyncMaster(decoderId, (int)syncMaster);
+			NativeSetPlaybackSpeed(decoderId, playbackSpeed);
+			NativeSetLoop(decoderId, loop, loopStart);
 			prepareCompleted.Invoke();
 			DebugLog("Init success");
 		}
@@ -209,27 +308,21 @@ public class VivistaPlayer : MonoBehaviour
 	{
 		ReleaseTextures();
 
-		var nativeTexY = new IntPtr();
-		var nativeTexU = new IntPtr();
-		var nativeTexV = new IntPtr();
-
 		var material = GetComponent<MeshRenderer>().sharedMaterial;
 
-		if (NativeCreateTexture(ref nativeTexY, ref nativeTexU, ref nativeTexV))
+		if (CreateNativeTextures(decoderId, videoWidth, videoHeight, atlasTexture, out videoTexY, out videoTexU, out videoTexV))
 		{
-			if (nativeTexY != IntPtr.Zero)
+			SetTextureLayout(material, atlasTexture, videoHeight);
+			if (videoTexY != null)
 			{
-				videoTexY = Texture2D.CreateExternalTexture(videoWidth, videoHeight, TextureFormat.Alpha8, false, false, nativeTexY);
 				material.SetTexture("_YTex", videoTexY);
 			}
-			if (nativeTexU != IntPtr.Zero)
+			if (videoTexU != null)
 			{
-				videoTexU = Texture2D.CreateExternalTexture(videoWidth / 2, videoHeight / 2, TextureFormat.Alpha8, false, false, nativeTexU);
 				material.SetTexture("_UTex", videoTexU);
 			}
-			if (nativeTexV != IntPtr.Zero)
+			if (videoTexV != null)
 			{
-				videoTexV = Texture2D.CreateExternalTexture(videoWidth / 2, videoHeight / 2, TextureFormat.Alpha8, false, false, nativeTexV);
 				material.SetTexture("_VTex", videoTexV);
 			}
 		}
@@ -239,6 +332,52 @@ public class VivistaPlayer : MonoBehaviour
 		}
 	}
 
+	// With the atlas layout only texY is created, it holds all three planes.
+	private static bool CreateNativeTextures(int id, int width, int height, bool isAtlas, out Texture2D texY, out Texture2D texU, out Texture2D texV)
+	{
+		texY = null;
+		texU = null;
+		texV = null;
+
+		NativeSetTextureLayout(id, isAtlas ? 1 : 0);
+
+		var nativeTexY = new IntPtr();
+		var nativeTexU = new IntPtr();
+		var nativeTexV = new IntPtr();
+
+		if (!NativeCreateTexture(id, ref nativeTexY, ref nativeTexU, ref nativeTexV))
+		{
+			return false;
+		}
+
+		if (nativeTexY != IntPtr.Zero)
+		{
+			texY = Texture2D.CreateExternalTexture(width, isAtlas ? height + height / 2 : height, TextureFormat.Alpha8, false, false, nativeTexY);
+		}
+		if (nativeTexU != IntPtr.Zero)
+		{
+			texU = Texture2D.CreateExternalTexture(width / 2, height / 2, TextureFormat.Alpha8, false, false, nativeTexU);
+		}
+		if (nativeTexV != IntPtr.Zero)
+		{
+			texV = Texture2D.CreateExternalTexture(width / 2, height / 2, TextureFormat.Alpha8, false, false, nativeTexV);
+		}
+		return true;
+	}
+
+	private static void SetTextureLayout(Material material, bool isAtlas, int height)
+	{
+		if (isAtlas)
+		{
+			material.EnableKeyword("YUV_ATLAS");
+			material.SetFloat("_AtlasLumaHeight", (float)height / (height + height / 2));
+		}
+		else
+		{
+			material.DisableKeyword("YUV_ATLAS");
+		}
+	}
+
 	private void ReleaseTextures()
 	{
 		SetTextures(null, null, null);
@@ -258,13 +397,15 @@ public class VivistaPlayer : MonoBehaviour
 
 	public void StartDecoding()
 	{
-		var videoInfo = NativeGetVideoInfo();
+		var videoInfo = NativeGetVideoInfo(decoderId);
 		videoWidth = videoInfo.width;
 		videoHeight = videoInfo.height;
 
 		CreateTextures();
 
-		if (!NativeStart())
+		NativeSetBufferLimits(decoderId, (long)bufferMegabytes * 1024 * 1024, bufferSeconds);
+
+		if (!NativeStart(decoderId))
 		{
 			DebugLog("Failed to start video");
 		}
@@ -273,7 +414,137 @@ public class VivistaPlayer : MonoBehaviour
 			DebugLog("Started video playback");
 		}
 
-		StartCoroutine(CallPluginAtEndOfFrames());
+		StartRenderLoop();
+	}
+
+	private void StartRenderLoop()
+	{
+		if (!isRenderLoopRunning)
+		{
+			isRenderLoopRunning = true;
+			StartCoroutine(CallPluginAtEndOfFrames());
+		}
+	}
+
+	// Opens the next clip in the background while the current one keeps playing, so SwapToPreloaded can show it right away.
+	public void Preload(string path)
+	{
+		DiscardPreload();
+		StartCoroutine(PreloadDecoder(path));
+	}
+
+	private IEnumerator PreloadDecoder(string path)
+	{
+		DebugLog("preload Decoder");
+
+		NativeSetDecoderThreading(0, decoderThreadCount, 0, 0, 0);
+		NativeSetCacheDirectory(Application.temporaryCachePath);
+		NativeSetFastOpen(fastOpen);
+		NativeSetAudioOutput(AudioSettings.outputSampleRate, keepAllAudioChannels);
+
+		int id = -1;
+		if (NativePreload(path, ref id) < 0)
+		{
+			DebugLog("Preload failed, all players are in use");
+			yield break;
+		}
+		preloadId = id;
+
+		int result;
+		do
+		{
+			yield return null;
+			// Discarded or replaced by another preload in the meantime
+			if (preloadId != id)
+			{
+				yield break;
+			}
+			result = NativeGetPlayerState(id);
+		}
+		while (result != 1 && result != -1 && result != 8);
+
+		if (result == -1)
+		{
+			DebugLog("Preload failed");
+			DiscardPreload();
+			yield break;
+		}
+
+		var videoInfo = NativeGetVideoInfo(id);
+		preloadWidth = videoInfo.width;
+		preloadHeight = videoInfo.height;
+		if (videoInfo.isEnabled && !CreateNativeTextures(id, preloadWidth, preloadHeight, atlasTexture, out preloadTexY, out preloadTexU, out preloadTexV))
+		{
+			DebugLog("Failed to create native textures");
+			DiscardPreload();
+			yield break;
+		}
+
+		NativeSetSyncMaster(id, (int)syncMaster);
+		NativeSetPlaybackSpeed(id, playbackSpeed);
+		NativeSetLoop(id, loop, loopStart);
+
+		preloadUrl = path;
+		isPreloadReady = true;
+		DebugLog("Preload success");
+	}
+
+	public bool IsPreloadReady()
+	{
+		return isPreloadReady;
+	}
+
+	// Replaces the playing clip with the preloaded one and starts it. The old clip is stopped in the background.
+	// Returns false while there is no preloaded clip ready or nothing has been prepared yet.
+	public bool SwapToPreloaded()
+	{
+		if (!isPreloadReady || decoderId < 0 || !NativeSwapPlayers(decoderId, preloadId))
+		{
+			return false;
+		}
+
+		url = preloadUrl;
+		videoWidth = preloadWidth;
+		videoHeight = preloadHeight;
+		videoTexY = preloadTexY;
+		videoTexU = preloadTexU;
+		videoTexV = preloadTexV;
+		SetTextures(videoTexY, videoTexU, videoTexV);
+		SetTextureLayout(GetComponent<MeshRenderer>().material, atlasTexture, videoHeight);
+
+		// The slot of the preload is empty now, its player lives on under decoderId.
+		preloadId = -1;
+		DiscardPreload();
+
+		NativeSetPriority(decoderId, (int)priority);
+		NativeSetBufferLimits(decoderId, (long)bufferMegabytes * 1024 * 1024, bufferSeconds);
+
+		if (!NativeStart(decoderId))
+		{
+			DebugLog("Failed to start video");
+		}
+		else
+		{
+			DebugLog("Swapped to preloaded video");
+		}
+
+		StartRenderLoop();
+		return true;
+	}
+
+	public void DiscardPreload()
+	{
+		if (preloadId >= 0)
+		{
+			NativeDestroy(preloadId);
+		}
+
+		preloadId = -1;
+		isPreloadReady = false;
+		preloadUrl = null;
+		preloadTexY = null;
+		preloadTexU = null;
+		preloadTexV = null;
 	}
 
 	public void DisableVideo(bool status)
@@ -286,6 +557,39 @@ public class VivistaPlayer : MonoBehaviour
 		SetAudioDisabledNative(status);
 	}
 
+	public void SetPriority(DecodePriority priority)
+	{
+		this.priority = priority;
+		NativeSetPriority(decoderId, (int)priority);
+	}
+
+	// 1 is normal speed, from 0.25 to 4. The audio keeps its pitch.
+	public void SetPlaybackSpeed(float speed)
+	{
+		playbackSpeed = speed;
+		NativeSetPlaybackSpeed(decoderId, speed);
+	}
+
+	// Has to be set before the end of the video is reached.
+	public void SetLoop(bool loop, float loopStart = 0)
+	{
+		this.loop = loop;
+		this.loopStart = loopStart;
+		NativeSetLoop(decoderId, loop, loopStart);
+	}
+
+	public void SetSyncMaster(SyncMaster syncMaster)
+	{
+		this.syncMaster = syncMaster;
+		NativeSetSyncMaster(decoderId, (int)syncMaster);
+	}
+
+	// Playback position in seconds by the native clock, -1 until the first frame is on screen.
+	public double GetPresentationTime()
+	{
+		return NativeGetPresentationTime(decoderId);
+	}
+
 	public void Mute()
 	{
 
@@ -297,21 +601,27 @@ public class VivistaPlayer : MonoBehaviour
 		{
 			yield return Yield.endOfFrame;
 
-			SetTimeFromUnity(Time.timeSinceLevelLoad);
-
-			GL.IssuePluginEvent(nativeUpdateFunc, 1);
+			GL.IssuePluginEvent(nativeUpdateFunc, decoderId);
 		}
 	}
 
+	// Runs on Unity's audio thread. The native side fills the buffer without blocking, with silence if it has nothing ready.
 	private void OnAudioFilterRead(float[] data, int channels)
 	{
-		int dataLen = data.Length / channels;
-
-		int n = 0;
-		while (n < dataLen)
+		int id = decoderId;
+		if (id < 0)
 		{
-
+			return;
 		}
+
+		NativeGetAudioSamples(id, data, data.Length / channels, channels);
+	}
+
+	public void GetAudioStats(out int underruns, out int overruns)
+	{
+		underruns = 0;
+		overruns = 0;
+		NativeGetAudioStats(decoderId, ref underruns, ref overruns);
 	}
 
 	private static void DebugLog(string message)
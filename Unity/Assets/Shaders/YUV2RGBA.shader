@@ -6,6 +6,7 @@
 		_YTex("Y channel", 2D) = "black" {}
 		_UTex("U channel", 2D) = "gray" {}
 		_VTex("V channel", 2D) = "gray" {}
+		_AtlasLumaHeight("Part of the atlas height that is Y", Float) = 0.6666667
 	}
 	SubShader
 	{
@@ -17,6 +18,8 @@
 			CGPROGRAM
 			#pragma vertex vert
 			#pragma fragment frag
+			//	YUV_ATLAS samples Y, U and V from the one texture in _YTex, Y at the top and U and V side by side below it.
+			#pragma multi_compile __ YUV_ATLAS
 			
 			#include "UnityCG.cginc"
 
@@ -36,6 +39,8 @@
 			sampler2D _YTex;
 			sampler2D _UTex;
 			sampler2D _VTex;
+			float4 _YTex_TexelSize;
+			float _AtlasLumaHeight;
 			
 			v2f vert (appdata v)
 			{
@@ -47,9 +52,21 @@
 			
 			fixed4 frag (v2f i) : SV_Target
 			{
+#if YUV_ATLAS
+				//	Stay half a texel inside each plane, so the filtering doesn't blend in its neighbour.
+				float2 halfTexel = _YTex_TexelSize.xy * 0.5;
+				float chromaHeight = 1 - _AtlasLumaHeight;
+				float2 luma = float2(i.uv.x, clamp(i.uv.y * _AtlasLumaHeight, halfTexel.y, _AtlasLumaHeight - halfTexel.y));
+				float2 chroma = float2(clamp(i.uv.x * 0.5, halfTexel.x, 0.5 - halfTexel.x), _AtlasLumaHeight + clamp(i.uv.y * chromaHeight, halfTexel.y, chromaHeight - halfTexel.y));
+
+				float ych = tex2D(_YTex, luma).a;
+				float uch = tex2D(_YTex, chroma).a - 0.5;
+				float vch = tex2D(_YTex, chroma + float2(0.5, 0)).a - 0.5;
+#else
 				float ych = tex2D(_YTex, i.uv).a;
 				float uch = tex2D(_UTex, i.uv).a - 0.5;
 				float vch = tex2D(_VTex, i.uv).a - 0.5;
+#endif
 
 				fixed4 col;
 				col.r = ych + 1.4 * vch;